@@ -0,0 +1,42 @@
+#!/bin/bash
+# Run serbench against the firmware under QEMU and print its JSON.
+#   bash bench.sh main.bin [serbench options]
+# The console must land on the pty the same way emulate.sh gets it on stdio;
+# set BENCH_SERIAL if the QEMU build maps -serial options differently.
+# BENCH_QEMU_OPTS goes to QEMU as it is.
+
+QEMU_STM32=${QEMU_STM32:-../qemu_stm32/arm-softmmu/qemu-system-arm}
+BENCH_SERIAL=${BENCH_SERIAL:-"-serial pty"}
+
+CUR=`dirname $0`
+LOG=`mktemp`
+KERNEL=$1
+shift
+
+$QEMU_STM32 \
+	-M stm32-p103 \
+	-kernel $KERNEL \
+	$BENCH_SERIAL \
+	$BENCH_QEMU_OPTS \
+	-parallel none \
+	-monitor none \
+	-nographic >$LOG 2>&1 </dev/null & pid=$!
+
+cleanup () {
+	kill $pid 2>/dev/null; sleep 1; kill -KILL $pid 2>/dev/null
+	rm -f $LOG
+}
+trap cleanup EXIT
+
+for i in `seq 50`; do
+	PTY=`sed -n 's/.*char device redirected to \(\/dev\/[^ ]*\).*/\1/p' $LOG | tail -n 1`
+	[ -n "$PTY" ] && break
+	sleep 0.1
+done
+if [ -z "$PTY" ]; then
+	cat $LOG >&2
+	echo "QEMU did not create a pty, giving up." >&2
+	exit 1
+fi
+
+$CUR/serbench "$@" $PTY
@@ -0,0 +1,316 @@
+#include "console.h"
+#include "serial_io.h"
+#include "stm32f10x.h"
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+
+#include <string.h>
+
+/* Single-producer single-consumer ring: only the owning task moves the
+ * head and only the console task moves the tail, so neither needs a lock.
+ * Both indices run free and are masked on use.
+ */
+struct console_ring_t {
+	volatile uint16_t head;
+	volatile uint16_t tail;
+	uint16_t size;
+	/* Console task only: when it first saw an unfinished line. */
+	int waiting;
+	portTickType since;
+	char *buf;
+};
+
+/* A slot whose owner is NULL has been released and is freed by the console
+ * task, the only one that may still be looking at it.
+ */
+struct console_slot_t {
+	volatile xTaskHandle owner;
+	volatile int flush;
+	/* Set by the owner while it waits for space; the console task then
+	 * gives space_sem each time it has served the slot.
+	 */
+	volatile int blocked;
+	xSemaphoreHandle space_sem;
+	struct console_ring_t out;
+	struct console_ring_t err;
+};
+
+static struct console_slot_t *console_slots[CONSOLE_SLOTS];
+static volatile int console_running = 0;
+/* Given by writers when there is work for the console task. */
+static xSemaphoreHandle console_wake_sem = NULL;
+
+__attribute__((constructor)) void init_console()
+{
+	if (console_wake_sem)
+		return;
+
+	vSemaphoreCreateBinary(console_wake_sem);
+	xSemaphoreTake(console_wake_sem, 0);
+}
+
+static uint16_t console_used(struct console_ring_t *r)
+{
+	return r->head - r->tail;
+}
+
+static int console_out_room(struct console_slot_t *s)
+{
+	return console_used(&s->out) < s->out.size;
+}
+
+static int console_err_room(struct console_slot_t *s)
+{
+	return console_used(&s->err) < s->err.size;
+}
+
+static int console_drained(struct console_slot_t *s)
+{
+	return !console_used(&s->out) && !console_used(&s->err);
+}
+
+static struct console_slot_t *console_find(xTaskHandle task)
+{
+	int i;
+
+	for (i = 0; i < CONSOLE_SLOTS; i++)
+		if (console_slots[i] && console_slots[i]->owner == task)
+			return console_slots[i];
+	return NULL;
+}
+
+/* The calling task's slot, claimed on its first write.  NULL when all are
+ * taken or memory is short.
+ */
+static struct console_slot_t *console_slot()
+{
+	xTaskHandle self = xTaskGetCurrentTaskHandle();
+	struct console_slot_t *s = console_find(self);
+	int i;
+
+	if (s)
+		return s;
+
+	s = pvPortMalloc(sizeof(struct console_slot_t) + CONSOLE_OUT_SIZE + CONSOLE_ERR_SIZE);
+	if (!s)
+		return NULL;
+	memset(s, 0, sizeof(struct console_slot_t));
+	vSemaphoreCreateBinary(s->space_sem);
+	if (!s->space_sem) {
+		vPortFree(s);
+		return NULL;
+	}
+	xSemaphoreTake(s->space_sem, 0);
+	s->owner = self;
+	s->out.size = CONSOLE_OUT_SIZE;
+	s->out.buf = (char *) (s + 1);
+	s->err.size = CONSOLE_ERR_SIZE;
+	s->err.buf = s->out.buf + CONSOLE_OUT_SIZE;
+
+	taskENTER_CRITICAL();
+	for (i = 0; i < CONSOLE_SLOTS; i++) {
+		if (!console_slots[i]) {
+			console_slots[i] = s;
+			break;
+		}
+	}
+	taskEXIT_CRITICAL();
+
+	if (i == CONSOLE_SLOTS) {
+		vSemaphoreDelete(s->space_sem);
+		vPortFree(s);
+		return NULL;
+	}
+	return s;
+}
+
+/* Sleep until the console task has served s, unless done() already holds
+ * once the console task is sure to see the request.
+ */
+static void console_wait(struct console_slot_t *s, int (*done)(struct console_slot_t *))
+{
+	s->blocked = 1;
+	__DMB();
+	if (!done(s)) {
+		xSemaphoreGive(console_wake_sem);
+		xSemaphoreTake(s->space_sem, portMAX_DELAY);
+	}
+	s->blocked = 0;
+}
+
+int console_write(int err, const char *buf, int len)
+{
+	struct console_slot_t *s;
+	struct console_ring_t *r;
+	uint16_t used, head;
+	int n, span, i, wake;
+
+	if (!console_running || !(s = console_slot()))
+		return serial_write(SERIAL_CONSOLE, buf, len);
+
+	/* A task's output stays in order: while one lane still holds some of
+	 * it, the rest follows in that lane.
+	 */
+	if (CONSOLE_ERR_LANE && err)
+		r = console_used(&s->out) ? &s->out : &s->err;
+	else
+		r = console_used(&s->err) ? &s->err : &s->out;
+
+	for (n = 0; n < len; n += span) {
+		head = r->head;
+		used = head - r->tail;
+		if (used == r->size) {
+			console_wait(s, r == &s->out ? console_out_room : console_err_room);
+			span = 0;
+			continue;
+		}
+
+		span = r->size - used;
+		if (span > len - n)
+			span = len - n;
+		wake = !used || used + span >= r->size / 2;
+		for (i = 0; i < span; i++) {
+			r->buf[(head + i) & (r->size - 1)] = buf[n + i];
+			wake |= buf[n + i] == '\n';
+		}
+		/* The data must be visible before the head that covers it. */
+		__DMB();
+		r->head = head + span;
+		if (wake)
+			xSemaphoreGive(console_wake_sem);
+	}
+
+	return len;
+}
+
+void console_flush()
+{
+	struct console_slot_t *s;
+
+	if (!console_running || !(s = console_find(xTaskGetCurrentTaskHandle())))
+		return;
+
+	s->flush = 1;
+	while (!console_drained(s))
+		console_wait(s, console_drained);
+	s->flush = 0;
+}
+
+void console_release()
+{
+	struct console_slot_t *s;
+
+	if (!console_running || !(s = console_find(xTaskGetCurrentTaskHandle())))
+		return;
+
+	console_flush();
+	s->owner = NULL;
+	xSemaphoreGive(console_wake_sem);
+}
+
+/* Send the next line of r, or what there is of it once it has waited long
+ * enough.  Returns whether anything was sent.
+ */
+static int console_serve(struct console_ring_t *r, int force, portTickType now)
+{
+	uint16_t head = r->head;
+	uint16_t tail = r->tail;
+	uint16_t end, len, span;
+
+	if (head == tail)
+		return 0;
+	__DMB();
+
+	for (end = tail; end != head; end++)
+		if (r->buf[end & (r->size - 1)] == '\n')
+			break;
+
+	if (end != head) {
+		end++;
+	} else if (!force && (uint16_t) (head - tail) < r->size) {
+		if (!r->waiting) {
+			r->waiting = 1;
+			r->since = now;
+		}
+		if (now - r->since < CONSOLE_LINGER)
+			return 0;
+	}
+
+	/* Hand the line over in at most two pieces, around the wrap. */
+	len = end - tail;
+	span = r->size - (tail & (r->size - 1));
+	if (span > len)
+		span = len;
+	serial_write(SERIAL_CONSOLE, r->buf + (tail & (r->size - 1)), span);
+	if (len > span)
+		serial_write(SERIAL_CONSOLE, r->buf, len - span);
+
+	__DMB();
+	r->tail = end;
+	r->waiting = 0;
+	return 1;
+}
+
+/* Wake the owner of s if it waits for the room just made. */
+static void console_served(struct console_slot_t *s)
+{
+	if (s->blocked)
+		xSemaphoreGive(s->space_sem);
+}
+
+void console_task(void *pvParameters)
+{
+	struct console_slot_t *s;
+	portTickType now;
+	int next = 0;
+	int i, k, busy, waiting;
+
+	console_running = 1;
+
+	for (;;) {
+		now = xTaskGetTickCount();
+		busy = 0;
+
+		/* Slots given up by their owners, which flushed them first. */
+		for (i = 0; i < CONSOLE_SLOTS; i++) {
+			if ((s = console_slots[i]) && !s->owner) {
+				console_slots[i] = NULL;
+				vSemaphoreDelete(s->space_sem);
+				vPortFree(s);
+			}
+		}
+
+		/* Error lanes first, a line from each. */
+		for (i = 0; i < CONSOLE_SLOTS; i++) {
+			if ((s = console_slots[i]) && console_serve(&s->err, s->flush, now)) {
+				console_served(s);
+				busy = 1;
+			}
+		}
+
+		/* Then one line per writer, starting after the last one served
+		 * so nobody is left behind.
+		 */
+		for (k = 0; k < CONSOLE_SLOTS; k++) {
+			i = (next + k) % CONSOLE_SLOTS;
+			if ((s = console_slots[i]) && console_serve(&s->out, s->flush, now)) {
+				console_served(s);
+				busy = 1;
+				next = (i + 1) % CONSOLE_SLOTS;
+				break;
+			}
+		}
+
+		if (busy)
+			continue;
+
+		/* Idle: sleep until woken, or until an unfinished line is due. */
+		waiting = 0;
+		for (i = 0; i < CONSOLE_SLOTS; i++)
+			if ((s = console_slots[i]) && (console_used(&s->out) || console_used(&s->err)))
+				waiting = 1;
+		xSemaphoreTake(console_wake_sem, waiting ? CONSOLE_LINGER : portMAX_DELAY);
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+/* Console output multiplexer.  Tasks writing to the console deposit their
+ * output in buffers of their own and return; the console task alone feeds
+ * the UART, a whole line at a time, taking turns between writers.  Error
+ * output goes in a separate lane that is drained first.
+ */
+
+/* Writers with buffers of their own; further ones write straight through. */
+#define CONSOLE_SLOTS 4
+/* Buffer sizes per writer, powers of two. */
+#define CONSOLE_OUT_SIZE 128
+#define CONSOLE_ERR_SIZE 64
+/* How long an unfinished line waits for its newline before it is sent. */
+#define CONSOLE_LINGER (configTICK_RATE_HZ / 20)
+/* Set to 0 to keep error output in line with the rest. */
+#define CONSOLE_ERR_LANE 1
+
+__attribute__((constructor)) void init_console();
+void console_task(void *pvParameters);
+
+/* Queue len bytes for the console; err selects the error lane.  Blocks
+ * only while the caller's own buffer is full.
+ */
+int console_write(int err, const char *buf, int len);
+/* Wait until everything the caller queued is handed to the serial driver. */
+void console_flush();
+/* Flush the caller's output and give its buffers back.  A task that has
+ * written to the console calls this before it deletes itself.
+ */
+void console_release();
+
+#endif
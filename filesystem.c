@@ -4,14 +4,16 @@
 
 #include <stdint.h>
 #include <string.h>
-#include <hash-djb2.h>
+#include "hash-murmur3.h"
 
 #define MAX_FS 16
 
 struct fs_t {
+    const char * name;
     uint32_t hash;
     fs_mount_t mount;
     fs_open_t cb;
+    fs_unlink_t unlink;
     void * opaque;
 };
 
@@ -22,15 +24,17 @@ __attribute__((constructor)) void fs_init() {
     memset(fss, 0, sizeof(fss));
 }
 
-int register_fs(const char * mountpoint, fs_mount_t fm_cb, fs_open_t callback, void * opaque) {
+int register_fs(const char * mountpoint, uint32_t hash, fs_mount_t fm_cb, fs_open_t callback, fs_unlink_t unlink_cb, void * opaque) {
     int i;
     DBGOUT("register_fs(\"%s\", %p, %p)\r\n", mountpoint, callback, opaque);
 
     for (i = 0; i < MAX_FS; i++) {
         if (!fss[i].cb) {
-            fss[i].hash = hash_djb2((const uint8_t *) mountpoint, -1);
+            fss[i].name = mountpoint;
+            fss[i].hash = hash;
             fss[i].mount = fm_cb;
             fss[i].cb = callback;
+            fss[i].unlink = unlink_cb;
             fss[i].opaque = opaque;
             return 0;
         }
@@ -39,31 +43,67 @@ int register_fs(const char * mountpoint, fs_mount_t fm_cb, fs_open_t callback, v
     return -1;
 }
 
-int fs_open(const char * path, int flags, int mode) {
+/* Strip the mount point off *path and return the index of its filesystem. */
+static int fs_find(const char ** path) {
+    const char * p = *path;
     const char * slash;
     uint32_t hash;
     int i;
-//    DBGOUT("fs_open(\"%s\", %i, %i)\r\n", path, flags, mode);
 
-    while (path[0] == '/')
-        path++;
+    while (p[0] == '/')
+        p++;
 
-    slash = strchr(path, '/');
+    slash = strchr(p, '/');
 
     if (!slash)
-        return -2;
+        return -1;
 
-    hash = hash_djb2((const uint8_t *) path, slash - path);
-    path = slash + 1;
+    hash = hash_murmur3((const uint8_t *) p, slash - p);
+    *path = slash + 1;
 
     for (i = 0; i < MAX_FS; i++) {
-        if (fss[i].hash == hash)
-            return fss[i].cb(fss[i].opaque, path, flags, mode);
+        if (fss[i].cb && fss[i].hash == hash)
+            return i;
+    }
+
+    return -1;
+}
+
+int fs_open(const char * path, int flags, int mode) {
+    int i;
+    DBGOUT_STR("fs_open(\"%s\", %i, %i)\r\n", path, flags, mode);
+
+    i = fs_find(&path);
+    if (i >= 0) {
+        int fd = fss[i].cb(fss[i].opaque, path, flags, mode);
+
+        if (fd >= 0)
+            fio_set_fs(fd, i);
+        return fd;
     }
 
     return -2;
 }
 
+int fs_unlink(const char * path) {
+    int i;
+    DBGOUT_STR("fs_unlink(\"%s\")\r\n", path);
+
+    i = fs_find(&path);
+    if (i < 0)
+        return -2;
+    if (!fss[i].unlink)
+        return -3;
+
+    return fss[i].unlink(fss[i].opaque, path);
+}
+
+const char * fs_get_name(int fs) {
+    if ((fs < 0) || (fs >= MAX_FS) || !fss[fs].cb)
+        return NULL;
+    return fss[fs].name;
+}
+
 int fs_mount(const char * path, file_attr_t * attr) {
     if (path) {
         const char * slash;
@@ -77,7 +117,7 @@ int fs_mount(const char * path, file_attr_t * attr) {
         if (!slash)
             slash = path + strlen(path);
 
-        hash = hash_djb2((const uint8_t *) path, slash - path);
+        hash = hash_murmur3((const uint8_t *) path, slash - path);
         memset(&mount_data, 0, sizeof(mount_data));
         for (i = 0; i < MAX_FS; i++) {
             if (fss[i].hash == hash) {
@@ -86,6 +126,9 @@ int fs_mount(const char * path, file_attr_t * attr) {
             }
         }
     }
+    /* No filesystem there, or one that cannot be listed, such as devfs. */
+    if (!mount_data.mount)
+        return -1;
     mount_data.opaque = mount_data.mount(mount_data.opaque, attr);
 
     return mount_data.opaque ? 1 : 0;
@@ -9,12 +9,20 @@
 
 typedef int (*fs_open_t)(void * opaque, const char * fname, int flags, int mode);
 typedef void * (*fs_mount_t)(void * mountpoint, file_attr_t * attr);
+typedef int (*fs_unlink_t)(void * opaque, const char * fname);
 
 /* Need to be called before using any other fs functions */
 __attribute__((constructor)) void fs_init();
 
-int register_fs(const char * mountpoint, fs_mount_t, fs_open_t callback, void * opaque);
+/* hash is hash_murmur3() of mountpoint, as hash-paths.h has it. */
+int register_fs(const char * mountpoint, uint32_t hash, fs_mount_t, fs_open_t callback, fs_unlink_t, void * opaque);
 int fs_open(const char * path, int flags, int mode);
+int fs_unlink(const char * path);
+/* Fill attr with the first entry of the filesystem mounted at path, or with
+ * the next one if path is NULL.  Returns 1 if more follow, 0 after the last
+ * and -1 if nothing that can be listed is mounted there.
+ */
 int fs_mount(const char * path, file_attr_t * attr);
+const char * fs_get_name(int fs);
 
 #endif
@@ -2,46 +2,189 @@
 #include <string.h>
 #include <FreeRTOS.h>
 #include <semphr.h>
+#include <task.h>
 #include <unistd.h>
+#include "stm32f10x.h"
 #include "fio.h"
 #include "filesystem.h"
 #include "osdebug.h"
 #include "hash-djb2.h"
+#include "hash-paths.h"
 #include "serial_io.h"
+#include "console.h"
+#include "framedev.h"
 
 static struct fddef_t fio_fds[MAX_FDS];
+static struct fio_stats_t fio_fs_stats[MAX_FS];
 
-static ssize_t stdin_read(void * opaque, void * buf, size_t count) {
-    int i;
+union fio_priv_t {
+    union fio_priv_t * next;
+    uint32_t data[FIO_PRIV_SIZE / sizeof(uint32_t)];
+};
+
+static union fio_priv_t fio_priv_pool[FIO_PRIV_BLOCKS];
+static union fio_priv_t * fio_priv_head = NULL;
+
+enum fio_op_t {
+    FIO_OP_READ,
+    FIO_OP_WRITE,
+    FIO_OP_SEEK,
+};
+
+/* Lock-free increment; several tasks may hit the same filesystem at once. */
+static void fio_stat_add(uint32_t * counter, uint32_t value) {
+    uint32_t v;
+
+    do {
+        v = __LDREXW(counter) + value;
+    } while (__STREXW(v, counter));
+}
+
+static void fio_stat_account(struct fio_stats_t * s, enum fio_op_t op, ssize_t bytes, portTickType blocked) {
+    switch (op) {
+    case FIO_OP_READ:
+        fio_stat_add(&s->reads, 1);
+        if (bytes > 0)
+            fio_stat_add(&s->read_bytes, bytes);
+        break;
+    case FIO_OP_WRITE:
+        fio_stat_add(&s->writes, 1);
+        if (bytes > 0)
+            fio_stat_add(&s->write_bytes, bytes);
+        break;
+    case FIO_OP_SEEK:
+        fio_stat_add(&s->seeks, 1);
+        break;
+    }
+    if (blocked)
+        fio_stat_add(&s->blocked_ticks, blocked);
+}
+
+static void fio_account(int fd, enum fio_op_t op, ssize_t bytes, portTickType start) {
+    portTickType blocked = xTaskGetTickCount() - start;
+    int fs = fio_fds[fd].fs;
+
+    fio_stat_account(&fio_fds[fd].stats, op, bytes, blocked);
+    if (fs > 0)
+        fio_stat_account(&fio_fs_stats[fs - 1], op, bytes, blocked);
+}
+
+/* Per-descriptor state of a serial device: the stdio descriptors and
+ * /dev/ttyS*.
+ */
+struct tty_fds_t {
+    int port;
+    /* Console output goes in the multiplexer's error lane. */
+    int err;
+    int nonblock;
+    portTickType timeout;
+};
+
+static ssize_t tty_read(void * opaque, void * buf, size_t count) {
+    struct tty_fds_t * f = (struct tty_fds_t *) opaque;
+    portTickType timeout = f->nonblock ? 0 : f->timeout;
+    size_t i;
     char * data = buf;
 
-    for (i = 0; i < count; i++)
-        data[i] = recv_byte(NULL);
+    /* Like stdio, get any prompt out before waiting for the answer. */
+    if (f->port == SERIAL_CONSOLE)
+        console_flush();
+
+    for (i = 0; i < count; ) {
+        int n = serial_read(f->port, data + i, count - i, timeout);
+
+        if (n <= 0)
+            break;
+        i += n;
+        /* A canonical read ends with the line. */
+        if (serial_get_mode(f->port) & SERIAL_ICANON)
+            break;
+    }
+
+    if ((i == 0) && f->nonblock) {
+        errno = EAGAIN;
+        return -1;
+    }
 
-    return count;
+    return i;
 }
 
-static ssize_t stdout_write(void * opaque, const void * buf, size_t count) {
-    int i;
-    const char * data = (const char *) buf;
+static ssize_t tty_write(void * opaque, const void * buf, size_t count) {
+    struct tty_fds_t * f = (struct tty_fds_t *) opaque;
+
+    if (f->port == SERIAL_CONSOLE)
+        return console_write(f->err, (const char *) buf, count);
+    return serial_write(f->port, (const char *) buf, count);
+}
 
-    for (i = 0; i < count; i++) {
-        if (data[i] == '\n')
-            send_byte('\r');
+static int tty_ioctl(void * opaque, int request, void * arg) {
+    struct tty_fds_t * f = (struct tty_fds_t *) opaque;
 
-        send_byte(data[i]);
+    switch (request) {
+    case FIO_NONBLOCK:
+        f->nonblock = *(int *) arg;
+        return 0;
+    case FIO_TIMEOUT:
+        f->timeout = *(portTickType *) arg;
+        return 0;
+    case FIO_NREAD:
+        *(int *) arg = serial_rx_available(f->port);
+        return 0;
+    case FIO_FLUSH:
+        serial_rx_flush(f->port);
+        if (f->port == SERIAL_CONSOLE)
+            console_flush();
+        serial_tx_flush(f->port);
+        return 0;
+    case FIO_TCGETS:
+        *(int *) arg = serial_get_mode(f->port);
+        return 0;
+    case FIO_TCSETS:
+        serial_set_mode(f->port, *(int *) arg);
+        return 0;
     }
 
-    return count;
+    errno = EINVAL;
+    return -1;
+}
+
+static int tty_close(void * opaque) {
+    fio_priv_free(opaque);
+    return 0;
+}
+
+static struct tty_fds_t * tty_fds_alloc(int port) {
+    struct tty_fds_t * f = fio_priv_alloc(sizeof(struct tty_fds_t));
+
+    if (f) {
+        f->port = port;
+        f->err = 0;
+        f->nonblock = 0;
+        f->timeout = portMAX_DELAY;
+    }
+    return f;
 }
 
 static xSemaphoreHandle fio_sem = NULL;
 
 __attribute__((constructor)) void fio_init() {
+    int i;
+
     memset(fio_fds, 0, sizeof(fio_fds));
-    fio_fds[0].fdread = stdin_read;
-    fio_fds[1].fdwrite = stdout_write;
-    fio_fds[2].fdwrite = stdout_write;
+    memset(fio_fs_stats, 0, sizeof(fio_fs_stats));
+    fio_priv_head = NULL;
+    for (i = FIO_PRIV_BLOCKS - 1; i >= 0; i--) {
+        fio_priv_pool[i].next = fio_priv_head;
+        fio_priv_head = fio_priv_pool + i;
+    }
+    fio_fds[0].fdread = tty_read;
+    fio_fds[1].fdwrite = tty_write;
+    fio_fds[2].fdwrite = tty_write;
+    for (i = 0; i < 3; i++) {
+        fio_fds[i].fdioctl = tty_ioctl;
+        fio_fds[i].opaque = tty_fds_alloc(SERIAL_CONSOLE);
+    }
+    ((struct tty_fds_t *) fio_fds[2].opaque)->err = 1;
     fio_sem = xSemaphoreCreateMutex();
 }
 
@@ -58,6 +201,9 @@ static int fio_is_open_int(int fd) {
               (fio_fds[fd].fdwrite == NULL) &&
               (fio_fds[fd].fdseek == NULL) &&
               (fio_fds[fd].fdclose == NULL) &&
+              (fio_fds[fd].fdioctl == NULL) &&
+              (fio_fds[fd].fdpread == NULL) &&
+              (fio_fds[fd].fdpwrite == NULL) &&
               (fio_fds[fd].opaque == NULL));
     return r;
 }
@@ -83,7 +229,7 @@ int fio_is_open(int fd) {
 
 int fio_open(fdread_t fdread, fdwrite_t fdwrite, fdseek_t fdseek, fdclose_t fdclose, void * opaque) {
     int fd;
-//    DBGOUT("fio_open(%p, %p, %p, %p, %p)\r\n", fdread, fdwrite, fdseek, fdclose, opaque);
+    DBGOUT("fio_open(%p, %p, %p, %p, %p)\r\n", fdread, fdwrite, fdseek, fdclose, opaque);
     xSemaphoreTake(fio_sem, portMAX_DELAY);
     fd = fio_findfd();
 
@@ -104,7 +250,9 @@ ssize_t fio_read(int fd, void * buf, size_t count) {
 //    DBGOUT("fio_read(%i, %p, %i)\r\n", fd, buf, count);
     if (fio_is_open_int(fd)) {
         if (fio_fds[fd].fdread) {
+            portTickType start = xTaskGetTickCount();
             r = fio_fds[fd].fdread(fio_fds[fd].opaque, buf, count);
+            fio_account(fd, FIO_OP_READ, r, start);
         } else {
             r = -3;
         }
@@ -119,7 +267,9 @@ ssize_t fio_write(int fd, const void * buf, size_t count) {
 //    DBGOUT("fio_write(%i, %p, %i)\r\n", fd, buf, count);
     if (fio_is_open_int(fd)) {
         if (fio_fds[fd].fdwrite) {
+            portTickType start = xTaskGetTickCount();
             r = fio_fds[fd].fdwrite(fio_fds[fd].opaque, buf, count);
+            fio_account(fd, FIO_OP_WRITE, r, start);
         } else {
             r = -3;
         }
@@ -134,7 +284,46 @@ off_t fio_seek(int fd, off_t offset, int whence) {
 //    DBGOUT("fio_seek(%i, %i, %i)\r\n", fd, offset, whence);
     if (fio_is_open_int(fd)) {
         if (fio_fds[fd].fdseek) {
+            portTickType start = xTaskGetTickCount();
             r = fio_fds[fd].fdseek(fio_fds[fd].opaque, offset, whence);
+            fio_account(fd, FIO_OP_SEEK, 0, start);
+        } else {
+            r = -3;
+        }
+    } else {
+        r = -2;
+    }
+    return r;
+}
+
+/* Positional I/O: the descriptor's own cursor is left untouched, so
+ * several tasks may share one descriptor without seeking.
+ */
+ssize_t fio_pread(int fd, void * buf, size_t count, off_t offset) {
+    ssize_t r = 0;
+//    DBGOUT("fio_pread(%i, %p, %i, %i)\r\n", fd, buf, count, offset);
+    if (fio_is_open_int(fd)) {
+        if (fio_fds[fd].fdpread) {
+            portTickType start = xTaskGetTickCount();
+            r = fio_fds[fd].fdpread(fio_fds[fd].opaque, buf, count, offset);
+            fio_account(fd, FIO_OP_READ, r, start);
+        } else {
+            r = -3;
+        }
+    } else {
+        r = -2;
+    }
+    return r;
+}
+
+ssize_t fio_pwrite(int fd, const void * buf, size_t count, off_t offset) {
+    ssize_t r = 0;
+//    DBGOUT("fio_pwrite(%i, %p, %i, %i)\r\n", fd, buf, count, offset);
+    if (fio_is_open_int(fd)) {
+        if (fio_fds[fd].fdpwrite) {
+            portTickType start = xTaskGetTickCount();
+            r = fio_fds[fd].fdpwrite(fio_fds[fd].opaque, buf, count, offset);
+            fio_account(fd, FIO_OP_WRITE, r, start);
         } else {
             r = -3;
         }
@@ -146,7 +335,7 @@ off_t fio_seek(int fd, off_t offset, int whence) {
 
 int fio_close(int fd) {
     int r = 0;
-//    DBGOUT("fio_close(%i)\r\n", fd);
+    DBGOUT("fio_close(%i)\r\n", fd);
     if (fio_is_open_int(fd)) {
         if (fio_fds[fd].fdclose)
             r = fio_fds[fd].fdclose(fio_fds[fd].opaque);
@@ -159,6 +348,21 @@ int fio_close(int fd) {
     return r;
 }
 
+int fio_ioctl(int fd, int request, void * arg) {
+    int r = 0;
+//    DBGOUT("fio_ioctl(%i, %i, %p)\r\n", fd, request, arg);
+    if (fio_is_open_int(fd)) {
+        if (fio_fds[fd].fdioctl) {
+            r = fio_fds[fd].fdioctl(fio_fds[fd].opaque, request, arg);
+        } else {
+            r = -3;
+        }
+    } else {
+        r = -2;
+    }
+    return r;
+}
+
 void fio_perror(const char * prefix) {
     int err = errno;
 
@@ -171,6 +375,9 @@ void fio_perror(const char * prefix) {
         case ENOENT:
             fio_write(2, "No such file or directory", 25);
         break;
+        case ENAMETOOLONG:
+            fio_write(2, "File name too long", 18);
+        break;
     }
     fio_write(2, "\n", 1);
 }
@@ -180,6 +387,18 @@ void fio_set_opaque(int fd, void * opaque) {
         fio_fds[fd].opaque = opaque;
 }
 
+void fio_set_ioctl(int fd, fdioctl_t fdioctl) {
+    if (fio_is_open_int(fd))
+        fio_fds[fd].fdioctl = fdioctl;
+}
+
+void fio_set_pio(int fd, fdpread_t fdpread, fdpwrite_t fdpwrite) {
+    if (fio_is_open_int(fd)) {
+        fio_fds[fd].fdpread = fdpread;
+        fio_fds[fd].fdpwrite = fdpwrite;
+    }
+}
+
 char *fio_getline(int fd, char *str, size_t n)
 {
     size_t i;
@@ -192,47 +411,143 @@ char *fio_getline(int fd, char *str, size_t n)
     return i > 0 || c == '\n'  || c == '\r' ? str : NULL;
 }
 
+/* Backends take one block per open descriptor for their private state
+ * and give it back from their close callback.
+ */
+void * fio_priv_alloc(size_t size) {
+    union fio_priv_t * p;
+
+    if (size > FIO_PRIV_SIZE)
+        return NULL;
+
+    taskENTER_CRITICAL();
+    p = fio_priv_head;
+    if (p)
+        fio_priv_head = p->next;
+    taskEXIT_CRITICAL();
+
+    if (!p)
+        errno = ENOMEM;
+    return p;
+}
+
+void fio_priv_free(void * priv) {
+    union fio_priv_t * p = (union fio_priv_t *) priv;
+
+    if (!p)
+        return;
+
+    taskENTER_CRITICAL();
+    p->next = fio_priv_head;
+    fio_priv_head = p;
+    taskEXIT_CRITICAL();
+}
+
+void fio_set_fs(int fd, int fs) {
+    if (fio_is_open_int(fd) && (fs >= 0) && (fs < MAX_FS))
+        fio_fds[fd].fs = fs + 1;
+}
+
+int fio_get_stats(int fd, struct fio_stats_t * stats) {
+    if (!fio_is_open_int(fd))
+        return -2;
+    memcpy(stats, &fio_fds[fd].stats, sizeof(*stats));
+    return 0;
+}
+
+int fio_get_fs_stats(int fs, struct fio_stats_t * stats) {
+    if ((fs < 0) || (fs >= MAX_FS))
+        return -2;
+    memcpy(stats, &fio_fs_stats[fs], sizeof(*stats));
+    return 0;
+}
+
 size_t fio_list(const char * dir, file_attr_t * attr, size_t n) {
     int ret;
     size_t i;
 
     xSemaphoreTake(fio_sem, portMAX_DELAY);
     ret = fs_mount(dir, &attr[0]);
-    for (i = 1; i < n && ret; i++)
+    for (i = 1; i < n && ret > 0; i++)
         ret = fs_mount(NULL, &attr[i]);
     xSemaphoreGive(fio_sem);
 
-    return i;
+    return ret < 0 ? 0 : i;
+}
+
+static int devfs_open_tty(int port, fdread_t fdread, fdwrite_t fdwrite) {
+    struct tty_fds_t * f;
+    int fd;
+
+    if (serial_open(port, SERIAL_DEFAULT_BAUD) < 0)
+        return -1;
+
+    f = tty_fds_alloc(port);
+    if (!f)
+        return -1;
+
+    fd = fio_open(fdread, fdwrite, NULL, tty_close, f);
+    if (fd >= 0)
+        fio_set_ioctl(fd, tty_ioctl);
+    else
+        fio_priv_free(f);
+    return fd;
 }
 
-#define stdin_hash 0x0BA00421
-#define stdout_hash 0x7FA08308
-#define stderr_hash 0x7FA058A3
+/* /dev/ttyS* are opened in the directions the open flags ask for.  The
+ * line discipline belongs to the port, so /dev/ttyS1 behaves as stdio.
+ */
+static int devfs_open_ttyS(int port, int flags) {
+    switch (flags & (O_WRONLY | O_RDWR)) {
+    case O_WRONLY:
+        return devfs_open_tty(port, NULL, tty_write);
+    case O_RDWR:
+        return devfs_open_tty(port, tty_read, tty_write);
+    }
+    return devfs_open_tty(port, tty_read, NULL);
+}
 
 static int devfs_open(void * opaque, const char * path, int flags, int mode) {
     uint32_t h = hash_djb2((const uint8_t *) path, -1);
-//    DBGOUT("devfs_open(%p, \"%s\", %i, %i)\r\n", opaque, path, flags, mode);
+    DBGOUT_STR("devfs_open(\"%s\", %i, %i)\r\n", path, flags, mode);
     switch (h) {
     case stdin_hash:
         if (flags & (O_WRONLY | O_RDWR))
             return -1;
-        return fio_open(stdin_read, NULL, NULL, NULL, NULL);
+        return devfs_open_tty(SERIAL_CONSOLE, tty_read, NULL);
         break;
     case stdout_hash:
         if (flags & O_RDONLY)
             return -1;
-        return fio_open(NULL, stdout_write, NULL, NULL, NULL);
+        return devfs_open_tty(SERIAL_CONSOLE, NULL, tty_write);
         break;
-    case stderr_hash:
+    case stderr_hash: {
+        int fd;
+
         if (flags & O_RDONLY)
             return -1;
-        return fio_open(NULL, stdout_write, NULL, NULL, NULL);
-        break;
+        fd = devfs_open_tty(SERIAL_CONSOLE, NULL, tty_write);
+        if (fd >= 0)
+            ((struct tty_fds_t *) fio_fds[fd].opaque)->err = 1;
+        return fd;
+    }
+    case ttyS0_hash:
+        return devfs_open_ttyS(0, flags);
+    case ttyS1_hash:
+        return devfs_open_ttyS(1, flags);
+    case ttyS2_hash:
+        return devfs_open_ttyS(2, flags);
+    case frame0_hash:
+        return frame_dev_open(0, flags);
+    case frame1_hash:
+        return frame_dev_open(1, flags);
+    case frame2_hash:
+        return frame_dev_open(2, flags);
     }
     return -1;
 }
 
 void register_devfs() {
     DBGOUT("Registering devfs.\r\n");
-    register_fs("dev", NULL, devfs_open, NULL);
+    register_fs("dev", dev_mount_hash, NULL, devfs_open, NULL, NULL);
 }
@@ -2,6 +2,7 @@
 #define __FIO_H__
 
 #include <stdio.h>
+#include <stdint.h>
 #include "fattr.h"
 
 enum open_types_t {
@@ -15,17 +16,49 @@ enum open_types_t {
 
 #define MAX_FDS 32
 
+/* Pool of per-open private blocks handed out to filesystem backends. */
+#define FIO_PRIV_SIZE 16
+#define FIO_PRIV_BLOCKS 16
+
+/* Generic fio_ioctl requests. */
+enum fio_ioctl_t {
+    FIO_NONBLOCK,   /* arg: int *, non-zero makes reads return at once */
+    FIO_TIMEOUT,    /* arg: portTickType *, read timeout (portMAX_DELAY: forever) */
+    FIO_NREAD,      /* arg: int *, set to the bytes readable without blocking */
+    FIO_FLUSH,      /* arg: unused, drop pending input and drain pending output */
+    FIO_TCGETS,     /* arg: int *, set to the SERIAL_* line discipline flags */
+    FIO_TCSETS,     /* arg: int *, new SERIAL_* line discipline flags */
+};
+
 typedef ssize_t (*fdread_t)(void * opaque, void * buf, size_t count);
 typedef ssize_t (*fdwrite_t)(void * opaque, const void * buf, size_t count);
 typedef off_t (*fdseek_t)(void * opaque, off_t offset, int whence);
 typedef int (*fdclose_t)(void * opaque);
+typedef int (*fdioctl_t)(void * opaque, int request, void * arg);
+typedef ssize_t (*fdpread_t)(void * opaque, void * buf, size_t count, off_t offset);
+typedef ssize_t (*fdpwrite_t)(void * opaque, const void * buf, size_t count, off_t offset);
+
+/* I/O accounting, kept per open descriptor and per registered filesystem. */
+struct fio_stats_t {
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t seeks;
+    uint32_t read_bytes;
+    uint32_t write_bytes;
+    uint32_t blocked_ticks;     /* ticks spent inside the backend callbacks */
+};
 
 struct fddef_t {
     fdread_t fdread;
     fdwrite_t fdwrite;
     fdseek_t fdseek;
     fdclose_t fdclose;
+    fdioctl_t fdioctl;
+    fdpread_t fdpread;
+    fdpwrite_t fdpwrite;
     void * opaque;
+    int fs;                     /* 0 if not opened by fs_open, else fs index + 1 */
+    struct fio_stats_t stats;
 };
 
 /* Need to be called before using any other fio functions */
@@ -36,11 +69,21 @@ int fio_open(fdread_t, fdwrite_t, fdseek_t, fdclose_t, void * opaque);
 ssize_t fio_read(int fd, void * buf, size_t count);
 ssize_t fio_write(int fd, const void * buf, size_t count);
 off_t fio_seek(int fd, off_t offset, int whence);
+ssize_t fio_pread(int fd, void * buf, size_t count, off_t offset);
+ssize_t fio_pwrite(int fd, const void * buf, size_t count, off_t offset);
 int fio_close(int fd);
+int fio_ioctl(int fd, int request, void * arg);
 void fio_perror(const char * prefix);
 void fio_set_opaque(int fd, void * opaque);
+void fio_set_ioctl(int fd, fdioctl_t fdioctl);
+void fio_set_pio(int fd, fdpread_t fdpread, fdpwrite_t fdpwrite);
 char *fio_getline(int fd, char *str, size_t n);
 size_t fio_list(const char * dir, file_attr_t * buf, size_t n);
+void * fio_priv_alloc(size_t size);
+void fio_priv_free(void * priv);
+void fio_set_fs(int fd, int fs);
+int fio_get_stats(int fd, struct fio_stats_t * stats);
+int fio_get_fs_stats(int fs, struct fio_stats_t * stats);
 
 void register_devfs();
 
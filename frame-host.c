@@ -0,0 +1,116 @@
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+#include "frame-host.h"
+
+static int frame_host_raw(int fd) {
+    struct termios t;
+
+    if (tcgetattr(fd, &t) < 0)
+        return -1;
+    cfmakeraw(&t);
+    t.c_cc[VMIN] = 1;
+    t.c_cc[VTIME] = 0;
+    return tcsetattr(fd, TCSANOW, &t);
+}
+
+static void frame_host_init(struct frame_host_t * h, int fd) {
+    memset(h, 0, sizeof(*h));
+    h->fd = fd;
+}
+
+int frame_host_open(struct frame_host_t * h, const char * path) {
+    int fd = open(path, O_RDWR | O_NOCTTY);
+
+    if (fd < 0)
+        return -1;
+    /* A pty may refuse termios calls from this side; that is fine. */
+    frame_host_raw(fd);
+    frame_host_init(h, fd);
+    return 0;
+}
+
+int frame_host_openpty(struct frame_host_t * h, char * name, size_t len) {
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    const char * slave;
+
+    if (fd < 0)
+        return -1;
+    if (grantpt(fd) < 0 || unlockpt(fd) < 0 || !(slave = ptsname(fd))) {
+        close(fd);
+        return -1;
+    }
+    snprintf(name, len, "%s", slave);
+    frame_host_raw(fd);
+    frame_host_init(h, fd);
+    return 0;
+}
+
+void frame_host_close(struct frame_host_t * h) {
+    if (h->fd >= 0)
+        close(h->fd);
+    h->fd = -1;
+}
+
+static int frame_host_write_all(int fd, const uint8_t * buf, int len) {
+    int n;
+
+    while (len > 0) {
+        n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int frame_host_send(struct frame_host_t * h, const void * buf, int len) {
+    uint8_t enc[FRAME_ENC_MAX];
+    int n;
+
+    if (len > FRAME_MTU) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    n = frame_encode(h->tx_seq++, buf, len, enc);
+    if (frame_host_write_all(h->fd, enc, n) < 0)
+        return -1;
+    h->tx_frames++;
+    return len;
+}
+
+int frame_host_recv(struct frame_host_t * h, void * buf, int len, int timeout_ms) {
+    struct pollfd pfd;
+    int n;
+
+    while ((n = frame_rx_next(&h->rx, buf, len)) < 0) {
+        pfd.fd = h->fd;
+        pfd.events = POLLIN;
+        n = poll(&pfd, 1, timeout_ms);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return n;
+
+        n = read(h->fd, h->rx.buf + h->rx.len, sizeof(h->rx.buf) - h->rx.len);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+        if (n <= 0)
+            return -1;
+        h->rx.len += n;
+    }
+
+    return n;
+}
@@ -0,0 +1,37 @@
+#ifndef __FRAME_HOST_H__
+#define __FRAME_HOST_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "frame.h"
+
+/* Host end of a frame link (see frame.h), over a tty or pty such as the
+ * one QEMU creates with -serial pty.
+ */
+struct frame_host_t {
+    int fd;
+    uint8_t tx_seq;
+    unsigned tx_frames;
+    struct frame_rx_t rx;
+};
+
+/* Open a tty or pty path and put it in raw mode.  Returns 0 or -1. */
+int frame_host_open(struct frame_host_t * h, const char * path);
+
+/* Create a local pty and use its master side; the slave path is stored in
+ * name, for the target or a test peer to open.  Returns 0 or -1.
+ */
+int frame_host_openpty(struct frame_host_t * h, char * name, size_t len);
+
+void frame_host_close(struct frame_host_t * h);
+
+/* Send one frame.  Returns len, or -1 on error. */
+int frame_host_send(struct frame_host_t * h, const void * buf, int len);
+
+/* Receive one frame, waiting at most timeout_ms (negative: forever).
+ * Returns the payload length copied into buf, 0 on timeout or -1 on
+ * error.
+ */
+int frame_host_recv(struct frame_host_t * h, void * buf, int len, int timeout_ms);
+
+#endif
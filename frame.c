@@ -0,0 +1,152 @@
+#include <stdint.h>
+#include "frame.h"
+
+/* CRC-16/CCITT, one byte at a time without a table. */
+uint16_t frame_crc16(uint16_t crc, const uint8_t * buf, int len) {
+    uint8_t x;
+
+    while (len--) {
+        x = (crc >> 8) ^ *buf++;
+        x ^= x >> 4;
+        crc = (crc << 8) ^ ((uint16_t) x << 12) ^ ((uint16_t) x << 5) ^ x;
+    }
+
+    return crc;
+}
+
+/* COBS encoder fed a byte at a time: code points at the length byte of
+ * the block being filled.
+ */
+struct cobs_enc_t {
+    uint8_t * code;
+    uint8_t * out;
+};
+
+static void cobs_put(struct cobs_enc_t * e, uint8_t b) {
+    if (b) {
+        *e->out++ = b;
+        if (++*e->code < 0xFF)
+            return;
+    }
+    /* A zero, or a full block: close the block and start a new one. */
+    e->code = e->out++;
+    *e->code = 1;
+}
+
+static void cobs_write(struct cobs_enc_t * e, const uint8_t * buf, int len) {
+    while (len--)
+        cobs_put(e, *buf++);
+}
+
+int frame_encode(uint8_t seq, const void * payload, int len, uint8_t * out) {
+    struct cobs_enc_t e;
+    uint16_t crc;
+    uint8_t tail[2];
+
+    crc = frame_crc16(0xFFFF, &seq, 1);
+    crc = frame_crc16(crc, (const uint8_t *) payload, len);
+    tail[0] = crc & 0xFF;
+    tail[1] = crc >> 8;
+
+    e.code = out;
+    e.out = out + 1;
+    *e.code = 1;
+    cobs_put(&e, seq);
+    cobs_write(&e, (const uint8_t *) payload, len);
+    cobs_write(&e, tail, 2);
+    *e.out++ = 0;
+
+    return e.out - out;
+}
+
+int frame_decode(uint8_t * buf, int len, uint8_t * seq) {
+    const uint8_t * in = buf;
+    const uint8_t * end = buf + len;
+    uint8_t * out = buf;
+    int code;
+    int n;
+
+    /* Decoding never writes ahead of the byte being read, so it is done
+     * in place.
+     */
+    while (in < end) {
+        code = *in++;
+        if (code == 0 || code - 1 > end - in)
+            return -1;
+        for (n = 1; n < code; n++)
+            *out++ = *in++;
+        if (code != 0xFF && in < end)
+            *out++ = 0;
+    }
+
+    n = out - buf;
+    if (n < FRAME_OVERHEAD)
+        return -1;
+    if (frame_crc16(0xFFFF, buf, n - 2) != (buf[n - 2] | (buf[n - 1] << 8)))
+        return -1;
+
+    *seq = buf[0];
+    n -= FRAME_OVERHEAD;
+    for (code = 0; code < n; code++)
+        buf[code] = buf[code + 1];
+
+    return n;
+}
+
+/* Drop the first n buffered bytes. */
+static void frame_rx_consume(struct frame_rx_t * r, int n) {
+    int i;
+
+    for (i = n; i < r->len; i++)
+        r->buf[i - n] = r->buf[i];
+    r->len -= n;
+    r->scan = 0;
+}
+
+int frame_rx_next(struct frame_rx_t * r, void * buf, int len) {
+    uint8_t seq;
+    int i, n;
+
+    for (;;) {
+        for (i = r->scan; i < r->len && r->buf[i]; i++);
+        r->scan = i;
+
+        if (i == r->len) {
+            if (r->len == (int) sizeof(r->buf)) {
+                /* Too long to be a frame: line noise.  Resynchronise on
+                 * the next delimiter.
+                 */
+                r->errors++;
+                r->len = r->scan = 0;
+            }
+            return -1;
+        }
+
+        /* Back-to-back delimiters are idle fill, not frames. */
+        n = i ? frame_decode(r->buf, i, &seq) : -2;
+        if (n == -1)
+            r->errors++;
+        if (n < 0) {
+            frame_rx_consume(r, i + 1);
+            continue;
+        }
+
+        if (r->synced && seq == r->seq) {
+            r->dups++;
+            frame_rx_consume(r, i + 1);
+            continue;
+        }
+        if (r->synced)
+            r->lost += (uint8_t) (seq - r->seq - 1);
+        r->seq = seq;
+        r->synced = 1;
+        r->frames++;
+
+        if (n > len)
+            n = len;
+        for (i = 0; i < n; i++)
+            ((uint8_t *) buf)[i] = r->buf[i];
+        frame_rx_consume(r, r->scan + 1);
+        return n;
+    }
+}
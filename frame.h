@@ -0,0 +1,64 @@
+#ifndef __FRAME_H__
+#define __FRAME_H__
+
+#include <stdint.h>
+
+/* Framed packets over a byte stream.  On the wire a frame is
+ *
+ *     COBS(seq, payload..., crc_lo, crc_hi) 0x00
+ *
+ * COBS leaves no zero byte inside the frame, so 0x00 always marks its end
+ * and a receiver resynchronises on the next one after line noise.  The
+ * CRC-16/CCITT (initial value 0xFFFF) covers seq and the payload.  seq is
+ * bumped for each frame sent so the receiver can count lost frames.
+ *
+ * The codec is shared by the target and the host tools, so it depends on
+ * nothing but <stdint.h>.
+ */
+
+/* Largest payload carried by one frame. */
+#define FRAME_MTU 128
+
+/* Bytes added around a payload before encoding: seq and CRC. */
+#define FRAME_OVERHEAD 3
+
+/* Largest encoded frame for a payload of n bytes, delimiter included. */
+#define FRAME_ENC_SIZE(n) ((n) + FRAME_OVERHEAD + ((n) + FRAME_OVERHEAD) / 254 + 2)
+#define FRAME_ENC_MAX FRAME_ENC_SIZE(FRAME_MTU)
+
+uint16_t frame_crc16(uint16_t crc, const uint8_t * buf, int len);
+
+/* Encode one frame into out, which must hold FRAME_ENC_SIZE(len) bytes.
+ * Returns the encoded length, delimiter included.
+ */
+int frame_encode(uint8_t seq, const void * payload, int len, uint8_t * out);
+
+/* Decode the len bytes before a delimiter in place.  On success returns
+ * the payload length, stores the sequence number in *seq and leaves the
+ * payload at buf.  Returns -1 on a malformed frame or a bad CRC.
+ */
+int frame_decode(uint8_t * buf, int len, uint8_t * seq);
+
+/* Receiving side of a link: bytes read from the line are appended at
+ * buf + len, at most sizeof(buf) - len of them, and frame_rx_next() takes
+ * frames out.  Start from all zeroes.
+ */
+struct frame_rx_t {
+    int len;
+    int scan;           /* bytes of buf known not to be delimiters */
+    int synced;         /* seq holds the last frame's number */
+    uint8_t seq;
+    uint32_t frames;
+    uint32_t errors;    /* frames dropped for a bad CRC or encoding */
+    uint32_t lost;      /* frames missing from the sequence */
+    uint32_t dups;      /* repeated frames dropped */
+    uint8_t buf[FRAME_ENC_MAX];
+};
+
+/* Take the next good frame out of what has been received, dropping bad,
+ * repeated and overlong ones, and copy its payload into buf, truncated to
+ * len.  Returns the bytes copied, or -1 if no whole frame is buffered yet.
+ */
+int frame_rx_next(struct frame_rx_t * r, void * buf, int len);
+
+#endif
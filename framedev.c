@@ -0,0 +1,222 @@
+#include <errno.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <semphr.h>
+#include <task.h>
+#include <unistd.h>
+#include "fio.h"
+#include "frame.h"
+#include "framedev.h"
+#include "serial_io.h"
+
+/* Frame link over one serial port, shared by every descriptor opened on
+ * it.  Links are allocated on first open and kept.
+ */
+struct frame_link_t {
+    xSemaphoreHandle rx_lock;
+    xSemaphoreHandle tx_lock;
+    struct frame_rx_t rx;
+    uint8_t tx_seq;
+    uint32_t tx_frames;
+    uint8_t tx_buf[FRAME_ENC_MAX];
+};
+
+static struct frame_link_t * frame_links[SERIAL_PORTS];
+
+struct frame_fds_t {
+    int port;
+    int nonblock;
+    portTickType timeout;
+};
+
+/* Wait for the next good frame and copy its payload into buf.  Returns the
+ * bytes copied, or 0 if nothing came within timeout ticks, counting the
+ * wait for another reader to finish.
+ */
+static int frame_recv(int port, void * buf, int len, portTickType timeout) {
+    struct frame_link_t * l = frame_links[port];
+    int ret;
+    int n;
+
+    if (!xSemaphoreTake(l->rx_lock, timeout))
+        return 0;
+
+    while ((ret = frame_rx_next(&l->rx, buf, len)) < 0) {
+        n = serial_read(port, (char *) l->rx.buf + l->rx.len,
+                        sizeof(l->rx.buf) - l->rx.len, timeout);
+        if (n <= 0) {
+            ret = 0;
+            break;
+        }
+        l->rx.len += n;
+    }
+
+    xSemaphoreGive(l->rx_lock);
+
+    return ret;
+}
+
+static ssize_t frame_read(void * opaque, void * buf, size_t count) {
+    struct frame_fds_t * f = (struct frame_fds_t *) opaque;
+    int n = frame_recv(f->port, buf, count, f->nonblock ? 0 : f->timeout);
+
+    if (!n && f->nonblock) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    return n;
+}
+
+static ssize_t frame_write(void * opaque, const void * buf, size_t count) {
+    struct frame_fds_t * f = (struct frame_fds_t *) opaque;
+    struct frame_link_t * l = frame_links[f->port];
+    int n;
+
+    if (count > FRAME_MTU) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    if (!xSemaphoreTake(l->tx_lock, f->nonblock ? 0 : f->timeout)) {
+        errno = EAGAIN;
+        return -1;
+    }
+    n = frame_encode(l->tx_seq++, buf, count, l->tx_buf);
+    serial_write(f->port, (const char *) l->tx_buf, n);
+    l->tx_frames++;
+    xSemaphoreGive(l->tx_lock);
+
+    return count;
+}
+
+static int frame_ioctl(void * opaque, int request, void * arg) {
+    struct frame_fds_t * f = (struct frame_fds_t *) opaque;
+    struct frame_link_t * l = frame_links[f->port];
+
+    switch (request) {
+    case FIO_NONBLOCK:
+        f->nonblock = *(int *) arg;
+        return 0;
+    case FIO_TIMEOUT:
+        f->timeout = *(portTickType *) arg;
+        return 0;
+    case FIO_NREAD:
+        /* Encoded bytes waiting; nonzero does not promise a whole frame. */
+        *(int *) arg = l->rx.len + serial_rx_available(f->port);
+        return 0;
+    case FIO_FLUSH:
+        while (!xSemaphoreTake(l->rx_lock, portMAX_DELAY));
+        l->rx.len = l->rx.scan = 0;
+        serial_rx_flush(f->port);
+        xSemaphoreGive(l->rx_lock);
+        serial_tx_flush(f->port);
+        return 0;
+    }
+
+    errno = EINVAL;
+    return -1;
+}
+
+static int frame_close(void * opaque) {
+    fio_priv_free(opaque);
+    return 0;
+}
+
+static struct frame_link_t * frame_link_get(int port) {
+    struct frame_link_t * l;
+
+    if (frame_links[port])
+        return frame_links[port];
+
+    l = pvPortMalloc(sizeof(struct frame_link_t));
+    if (!l)
+        return NULL;
+    memset(l, 0, sizeof(struct frame_link_t));
+    l->rx_lock = xSemaphoreCreateMutex();
+    l->tx_lock = xSemaphoreCreateMutex();
+
+    /* Two tasks may race to open the first descriptor; keep one link. */
+    if (l->rx_lock && l->tx_lock) {
+        taskENTER_CRITICAL();
+        if (!frame_links[port]) {
+            frame_links[port] = l;
+            l = NULL;
+        }
+        taskEXIT_CRITICAL();
+    }
+
+    /* Lost the race, or short of memory: drop ours whole. */
+    if (l) {
+        if (l->rx_lock)
+            vSemaphoreDelete(l->rx_lock);
+        if (l->tx_lock)
+            vSemaphoreDelete(l->tx_lock);
+        vPortFree(l);
+    }
+
+    return frame_links[port];
+}
+
+int frame_dev_open(int port, int flags) {
+    struct frame_fds_t * f;
+    fdread_t fdread = frame_read;
+    fdwrite_t fdwrite = frame_write;
+    int fd;
+
+    /* Raw mode would take the shell's line editing and echo away. */
+    if (port == SERIAL_CONSOLE) {
+        errno = EBUSY;
+        return -1;
+    }
+    if (serial_open(port, SERIAL_DEFAULT_BAUD) < 0)
+        return -1;
+    if (!frame_link_get(port))
+        return -1;
+
+    /* Frames are binary; no byte may be edited or echoed. */
+    serial_set_mode(port, SERIAL_MODE_RAW);
+
+    f = fio_priv_alloc(sizeof(struct frame_fds_t));
+    if (!f)
+        return -1;
+    f->port = port;
+    f->nonblock = 0;
+    f->timeout = portMAX_DELAY;
+
+    switch (flags & (O_WRONLY | O_RDWR)) {
+    case O_WRONLY:
+        fdread = NULL;
+        break;
+    case O_RDWR:
+        break;
+    default:
+        fdwrite = NULL;
+        break;
+    }
+
+    fd = fio_open(fdread, fdwrite, NULL, frame_close, f);
+    if (fd >= 0)
+        fio_set_ioctl(fd, frame_ioctl);
+    else
+        fio_priv_free(f);
+    return fd;
+}
+
+int frame_get_stats(int port, struct frame_stats_t * stats) {
+    struct frame_link_t * l;
+
+    if (port < 0 || port >= SERIAL_PORTS || !frame_links[port])
+        return -1;
+
+    l = frame_links[port];
+    taskENTER_CRITICAL();
+    stats->rx_frames = l->rx.frames;
+    stats->rx_errors = l->rx.errors;
+    stats->rx_lost = l->rx.lost;
+    stats->rx_dups = l->rx.dups;
+    stats->tx_frames = l->tx_frames;
+    taskEXIT_CRITICAL();
+
+    return 0;
+}
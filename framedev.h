@@ -0,0 +1,23 @@
+#ifndef __FRAMEDEV_H__
+#define __FRAMEDEV_H__
+
+#include <stdint.h>
+
+struct frame_stats_t {
+    uint32_t rx_frames;
+    uint32_t rx_errors;     /* frames dropped for a bad CRC or encoding */
+    uint32_t rx_lost;       /* frames missing from the sequence */
+    uint32_t rx_dups;       /* repeated frames dropped */
+    uint32_t tx_frames;
+};
+
+/* Open a datagram descriptor on a serial port: each fio_write() sends one
+ * frame of at most FRAME_MTU bytes and each fio_read() returns the payload
+ * of one frame, truncated to the buffer.  The port is switched to raw
+ * mode, so the console port is refused with EBUSY.
+ */
+int frame_dev_open(int port, int flags);
+
+int frame_get_stats(int port, struct frame_stats_t * stats);
+
+#endif
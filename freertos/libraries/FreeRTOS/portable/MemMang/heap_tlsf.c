@@ -0,0 +1,401 @@
+/*
+ * An implementation of pvPortMalloc() and vPortFree() using Two-Level
+ * Segregated Fit: free blocks are kept in lists by size class, a first level
+ * of power of two ranges each split linearly into tlsfSL_COUNT second level
+ * classes, with a bitmap of the non-empty lists at both levels.  Finding a
+ * class that is large enough is then a couple of bit scans, and freeing
+ * merges with the blocks either side in constant time, so both take a bounded
+ * time however many blocks are free.  Requests are rounded up to the class
+ * size, wasting at most 1 / tlsfSL_COUNT of a block, in exchange for never
+ * searching a list.
+ *
+ * Drop-in for heap_4.c: same heap array, sizing and locking.  See heap_1.c,
+ * heap_2.c, heap_3.c and heap_4.c for the alternatives.
+ */
+#include <stdlib.h>
+
+/* Defining MPU_WRAPPERS_INCLUDED_FROM_API_FILE prevents task.h from redefining
+all the API functions to use the MPU wrappers.  That should only be done when
+task.h is included from an application file. */
+#define MPU_WRAPPERS_INCLUDED_FROM_API_FILE
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#undef MPU_WRAPPERS_INCLUDED_FROM_API_FILE
+
+/* log2 of the number of second level classes in each first level range. */
+#define tlsfSL_COUNT_LOG2		4
+#define tlsfSL_COUNT			( 1 << tlsfSL_COUNT_LOG2 )
+
+/* Block sizes are multiples of the alignment, which leaves the low bits of
+the size free for the flags below. */
+#define tlsfALIGN_LOG2			3
+
+/* Blocks smaller than this all go in the first range, split into classes one
+alignment unit apart. */
+#define tlsfFL_SHIFT			( tlsfSL_COUNT_LOG2 + tlsfALIGN_LOG2 )
+#define tlsfSMALL_BLOCK			( ( size_t ) 1 << tlsfFL_SHIFT )
+
+/* Blocks must be smaller than 2 ^ ( tlsfFL_MAX + 1 ) bytes. */
+#define tlsfFL_MAX				15
+#define tlsfFL_COUNT			( tlsfFL_MAX - tlsfFL_SHIFT + 2 )
+
+#if portBYTE_ALIGNMENT > ( 1 << tlsfALIGN_LOG2 )
+	#error heap_tlsf.c aligns blocks to 8 bytes only.
+#endif
+
+/* Set in xSize when the block is free, and when the block before it is. */
+#define tlsfBLOCK_FREE			( ( size_t ) 1 )
+#define tlsfPREV_FREE			( ( size_t ) 2 )
+#define tlsfSIZE_MASK			( ~( size_t ) ( ( 1 << tlsfALIGN_LOG2 ) - 1 ) )
+
+/* The header at the start of every block.  pxNextFree and pxPrevFree are only
+there while the block is free; an allocated block's memory starts at them. */
+typedef struct A_TLSF_BLOCK
+{
+	struct A_TLSF_BLOCK *pxPrevPhys;	/*<< The block just below this one in memory. */
+	size_t xSize;						/*<< Size of the whole block, with the flags. */
+	struct A_TLSF_BLOCK *pxNextFree;	/*<< The next free block of the same class. */
+	struct A_TLSF_BLOCK *pxPrevFree;	/*<< The previous free block of the same class. */
+} xTLSFBlock;
+
+/* Bytes of header before the memory handed out. */
+#define tlsfHEADER_SIZE			( sizeof( xTLSFBlock * ) + sizeof( size_t ) )
+
+/* A free block must hold the whole structure. */
+#define tlsfMIN_BLOCK_SIZE		( ( sizeof( xTLSFBlock ) + ( 1 << tlsfALIGN_LOG2 ) - 1 ) & tlsfSIZE_MASK )
+
+/* A few bytes might be lost to byte aligning the heap start address. */
+#define heapADJUSTED_HEAP_SIZE	( configTOTAL_HEAP_SIZE - ( 1 << tlsfALIGN_LOG2 ) )
+
+/* Allocate the memory for the heap. */
+static unsigned char ucHeap[ configTOTAL_HEAP_SIZE ];
+
+/* Bit n of ulFLBitmap is set when some list in range n holds a block, and bit
+m of ulSLBitmap[ n ] when list pxFreeLists[ n ][ m ] does. */
+static unsigned long ulFLBitmap = 0;
+static unsigned long ulSLBitmap[ tlsfFL_COUNT ];
+static xTLSFBlock *pxFreeLists[ tlsfFL_COUNT ][ tlsfSL_COUNT ];
+
+/* Marks the end of the heap: a block of size 0 that is never free, so every
+real block has a block after it. */
+static xTLSFBlock *pxEnd = NULL;
+
+/* Keeps track of the number of free bytes remaining, but says nothing about
+fragmentation. */
+static size_t xFreeBytesRemaining = 0;
+
+/*-----------------------------------------------------------*/
+
+/*
+ * Index of the most significant bit set in ulValue, which must not be 0.
+ */
+#define prvFLS( ulValue )		( 31 - __builtin_clz( ulValue ) )
+
+/*
+ * Index of the least significant bit set in ulValue, which must not be 0.
+ */
+#define prvFFS( ulValue )		( __builtin_ctz( ulValue ) )
+
+/*
+ * The class a block of xSize bytes is listed under.
+ */
+static void prvMappingInsert( size_t xSize, unsigned long *pulFL, unsigned long *pulSL );
+
+/*
+ * Remove pxBlock from the free list of its class, or add it to the head of
+ * that list.
+ */
+static void prvRemoveFreeBlock( xTLSFBlock *pxBlock );
+static void prvInsertFreeBlock( xTLSFBlock *pxBlock );
+
+/*
+ * Take a free block of at least xWantedSize bytes off its list, or return
+ * NULL if there is none.
+ */
+static xTLSFBlock *prvFindFreeBlock( size_t xWantedSize );
+
+/*
+ * Called automatically to setup the required heap structures the first time
+ * pvPortMalloc() is called.
+ */
+static void prvHeapInit( void );
+
+/*-----------------------------------------------------------*/
+
+#define prvBlockSize( pxBlock )		( ( pxBlock )->xSize & tlsfSIZE_MASK )
+#define prvNextPhys( pxBlock )		( ( xTLSFBlock * ) ( ( ( unsigned char * ) ( pxBlock ) ) + prvBlockSize( pxBlock ) ) )
+
+/*-----------------------------------------------------------*/
+
+void *pvPortMalloc( size_t xWantedSize )
+{
+xTLSFBlock *pxBlock, *pxNewBlock;
+size_t xRemaining;
+void *pvReturn = NULL;
+
+	vTaskSuspendAll();
+	{
+		/* If this is the first call to malloc then the heap will require
+		initialisation to setup the free lists. */
+		if( pxEnd == NULL )
+		{
+			prvHeapInit();
+		}
+
+		/* Anything larger than the heap cannot be satisfied, and checking
+		first keeps the sums below from overflowing. */
+		if( ( xWantedSize > 0 ) && ( xWantedSize <= xFreeBytesRemaining ) )
+		{
+			/* Add the header, and round up to the alignment and to the
+			smallest block that can be listed again once freed. */
+			xWantedSize = ( xWantedSize + tlsfHEADER_SIZE + ( 1 << tlsfALIGN_LOG2 ) - 1 ) & tlsfSIZE_MASK;
+			if( xWantedSize < tlsfMIN_BLOCK_SIZE )
+			{
+				xWantedSize = tlsfMIN_BLOCK_SIZE;
+			}
+
+			pxBlock = prvFindFreeBlock( xWantedSize );
+			if( pxBlock != NULL )
+			{
+				xRemaining = prvBlockSize( pxBlock ) - xWantedSize;
+
+				if( xRemaining >= tlsfMIN_BLOCK_SIZE )
+				{
+					/* Split off the end of the block and list it again.  The
+					block after it keeps its previous free flag. */
+					pxNewBlock = ( xTLSFBlock * ) ( ( ( unsigned char * ) pxBlock ) + xWantedSize );
+					pxNewBlock->pxPrevPhys = pxBlock;
+					pxNewBlock->xSize = xRemaining | tlsfBLOCK_FREE;
+					prvNextPhys( pxNewBlock )->pxPrevPhys = pxNewBlock;
+					prvInsertFreeBlock( pxNewBlock );
+
+					pxBlock->xSize = xWantedSize | ( pxBlock->xSize & tlsfPREV_FREE );
+				}
+				else
+				{
+					/* The whole block goes. */
+					prvNextPhys( pxBlock )->xSize &= ~tlsfPREV_FREE;
+					pxBlock->xSize &= ~tlsfBLOCK_FREE;
+				}
+
+				xFreeBytesRemaining -= prvBlockSize( pxBlock );
+
+				/* Return the memory after the header. */
+				pvReturn = ( void * ) ( ( ( unsigned char * ) pxBlock ) + tlsfHEADER_SIZE );
+			}
+		}
+	}
+	xTaskResumeAll();
+
+	#if( configUSE_MALLOC_FAILED_HOOK == 1 )
+	{
+		if( pvReturn == NULL )
+		{
+			extern void vApplicationMallocFailedHook( void );
+			vApplicationMallocFailedHook();
+		}
+	}
+	#endif
+
+	return pvReturn;
+}
+/*-----------------------------------------------------------*/
+
+void vPortFree( void *pv )
+{
+xTLSFBlock *pxBlock, *pxNext;
+
+	if( pv != NULL )
+	{
+		/* The header is immediately before the memory. */
+		pxBlock = ( xTLSFBlock * ) ( ( ( unsigned char * ) pv ) - tlsfHEADER_SIZE );
+
+		/* Check the block is actually allocated. */
+		configASSERT( ( pxBlock->xSize & tlsfBLOCK_FREE ) == 0 );
+
+		if( ( pxBlock->xSize & tlsfBLOCK_FREE ) == 0 )
+		{
+			vTaskSuspendAll();
+			{
+				xFreeBytesRemaining += prvBlockSize( pxBlock );
+				pxBlock->xSize |= tlsfBLOCK_FREE;
+
+				/* Merge with the block below if it is free.  Its own
+				previous block cannot be, so no flag needs carrying over. */
+				if( ( pxBlock->xSize & tlsfPREV_FREE ) != 0 )
+				{
+					pxNext = pxBlock;
+					pxBlock = pxBlock->pxPrevPhys;
+					prvRemoveFreeBlock( pxBlock );
+					pxBlock->xSize += prvBlockSize( pxNext );
+				}
+
+				/* And with the block above. */
+				pxNext = prvNextPhys( pxBlock );
+				if( ( pxNext->xSize & tlsfBLOCK_FREE ) != 0 )
+				{
+					prvRemoveFreeBlock( pxNext );
+					pxBlock->xSize += prvBlockSize( pxNext );
+					pxNext = prvNextPhys( pxBlock );
+				}
+
+				pxNext->pxPrevPhys = pxBlock;
+				pxNext->xSize |= tlsfPREV_FREE;
+				prvInsertFreeBlock( pxBlock );
+			}
+			xTaskResumeAll();
+		}
+	}
+}
+/*-----------------------------------------------------------*/
+
+size_t xPortGetFreeHeapSize( void )
+{
+	return xFreeBytesRemaining;
+}
+/*-----------------------------------------------------------*/
+
+void vPortInitialiseBlocks( void )
+{
+	/* This just exists to keep the linker quiet. */
+}
+/*-----------------------------------------------------------*/
+
+static void prvMappingInsert( size_t xSize, unsigned long *pulFL, unsigned long *pulSL )
+{
+unsigned long ulBit;
+
+	if( xSize < tlsfSMALL_BLOCK )
+	{
+		*pulFL = 0;
+		*pulSL = xSize >> tlsfALIGN_LOG2;
+	}
+	else
+	{
+		/* The top bit picks the range, the tlsfSL_COUNT_LOG2 bits below it
+		the class within. */
+		ulBit = prvFLS( xSize );
+		*pulFL = ulBit - tlsfFL_SHIFT + 1;
+		*pulSL = ( xSize >> ( ulBit - tlsfSL_COUNT_LOG2 ) ) ^ tlsfSL_COUNT;
+	}
+}
+/*-----------------------------------------------------------*/
+
+static void prvRemoveFreeBlock( xTLSFBlock *pxBlock )
+{
+unsigned long ulFL, ulSL;
+
+	prvMappingInsert( prvBlockSize( pxBlock ), &ulFL, &ulSL );
+
+	if( pxBlock->pxNextFree != NULL )
+	{
+		pxBlock->pxNextFree->pxPrevFree = pxBlock->pxPrevFree;
+	}
+
+	if( pxBlock->pxPrevFree != NULL )
+	{
+		pxBlock->pxPrevFree->pxNextFree = pxBlock->pxNextFree;
+	}
+	else
+	{
+		/* It was the head of the list. */
+		pxFreeLists[ ulFL ][ ulSL ] = pxBlock->pxNextFree;
+		if( pxBlock->pxNextFree == NULL )
+		{
+			ulSLBitmap[ ulFL ] &= ~( 1UL << ulSL );
+			if( ulSLBitmap[ ulFL ] == 0 )
+			{
+				ulFLBitmap &= ~( 1UL << ulFL );
+			}
+		}
+	}
+}
+/*-----------------------------------------------------------*/
+
+static void prvInsertFreeBlock( xTLSFBlock *pxBlock )
+{
+unsigned long ulFL, ulSL;
+
+	prvMappingInsert( prvBlockSize( pxBlock ), &ulFL, &ulSL );
+
+	pxBlock->pxPrevFree = NULL;
+	pxBlock->pxNextFree = pxFreeLists[ ulFL ][ ulSL ];
+	if( pxBlock->pxNextFree != NULL )
+	{
+		pxBlock->pxNextFree->pxPrevFree = pxBlock;
+	}
+	pxFreeLists[ ulFL ][ ulSL ] = pxBlock;
+
+	ulSLBitmap[ ulFL ] |= 1UL << ulSL;
+	ulFLBitmap |= 1UL << ulFL;
+}
+/*-----------------------------------------------------------*/
+
+static xTLSFBlock *prvFindFreeBlock( size_t xWantedSize )
+{
+unsigned long ulFL, ulSL, ulMap;
+xTLSFBlock *pxBlock;
+
+	/* Round up to the next class boundary, so that every block in the
+	class found is large enough without looking at any of them. */
+	if( xWantedSize >= tlsfSMALL_BLOCK )
+	{
+		xWantedSize += ( ( size_t ) 1 << ( prvFLS( xWantedSize ) - tlsfSL_COUNT_LOG2 ) ) - 1;
+	}
+	prvMappingInsert( xWantedSize, &ulFL, &ulSL );
+	if( ulFL >= tlsfFL_COUNT )
+	{
+		return NULL;
+	}
+
+	/* A class of this range at least as large, or else the smallest
+	class of a larger range. */
+	ulMap = ulSLBitmap[ ulFL ] & ( ~0UL << ulSL );
+	if( ulMap == 0 )
+	{
+		ulMap = ulFLBitmap & ( ~0UL << ulFL << 1 );
+		if( ulMap == 0 )
+		{
+			return NULL;
+		}
+		ulFL = prvFFS( ulMap );
+		ulMap = ulSLBitmap[ ulFL ];
+	}
+	ulSL = prvFFS( ulMap );
+
+	pxBlock = pxFreeLists[ ulFL ][ ulSL ];
+	prvRemoveFreeBlock( pxBlock );
+
+	return pxBlock;
+}
+/*-----------------------------------------------------------*/
+
+static void prvHeapInit( void )
+{
+xTLSFBlock *pxFirstBlock;
+unsigned char *pucAlignedHeap;
+size_t xTotalHeapSize = ( ( size_t ) heapADJUSTED_HEAP_SIZE ) & tlsfSIZE_MASK;
+
+	/* The heap must fit in the largest range. */
+	configASSERT( xTotalHeapSize < ( ( size_t ) 2 << tlsfFL_MAX ) );
+
+	/* Ensure the heap starts on a correctly aligned boundary. */
+	pucAlignedHeap = ( unsigned char * ) ( ( ( portPOINTER_SIZE_TYPE ) &ucHeap[ 1 << tlsfALIGN_LOG2 ] ) & ( ( portPOINTER_SIZE_TYPE ) tlsfSIZE_MASK ) );
+
+	/* pxEnd takes a whole block structure at the top, though only its
+	header is used, so that it is an object of its type.  It is never free
+	and never merged, and follows the single free block the heap starts
+	as. */
+	pxEnd = ( xTLSFBlock * ) ( pucAlignedHeap + xTotalHeapSize - tlsfMIN_BLOCK_SIZE );
+	pxFirstBlock = ( xTLSFBlock * ) pucAlignedHeap;
+
+	pxFirstBlock->pxPrevPhys = NULL;
+	pxFirstBlock->xSize = ( xTotalHeapSize - tlsfMIN_BLOCK_SIZE ) | tlsfBLOCK_FREE;
+	pxEnd->pxPrevPhys = pxFirstBlock;
+	pxEnd->xSize = tlsfPREV_FREE;
+
+	xFreeBytesRemaining = prvBlockSize( pxFirstBlock );
+	prvInsertFreeBlock( pxFirstBlock );
+}
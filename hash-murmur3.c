@@ -0,0 +1,59 @@
+#include <stdint.h>
+#include <string.h>
+#include "hash-murmur3.h"
+#include "word-util.h"
+
+#define ROTL32(x, r) (((x) << (r)) | ((x) >> (32 - (r))))
+
+#define MURMUR3_C1 0xcc9e2d51
+#define MURMUR3_C2 0x1b873593
+
+static uint32_t murmur3_mix(uint32_t k) {
+    k *= MURMUR3_C1;
+    k = ROTL32(k, 15);
+    return k * MURMUR3_C2;
+}
+
+uint32_t hash_murmur3(const uint8_t * str, ssize_t max) {
+    const uint8_t * end;
+    uint32_t hash = 0;
+    uint32_t k = 0;
+    uint32_t len;
+
+    /* Find the length first, so that the blocks below never read past
+     * the string.
+     */
+    if (max < 0) {
+        len = strlen((const char *) str);
+    } else {
+        end = memchr(str, 0, max);
+        len = end ? end - str : (uint32_t) max;
+    }
+
+    for (end = str + (len & ~3); str < end; str += 4) {
+        hash ^= murmur3_mix(LOAD32(str));
+        hash = ROTL32(hash, 13);
+        hash = hash * 5 + 0xe6546b64;
+    }
+
+    switch (len & 3) {
+    case 3:
+        k ^= str[2] << 16;
+        /* fall through */
+    case 2:
+        k ^= str[1] << 8;
+        /* fall through */
+    case 1:
+        k ^= str[0];
+        hash ^= murmur3_mix(k);
+    }
+
+    hash ^= len;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+
+    return hash;
+}
@@ -0,0 +1,13 @@
+#ifndef __HASH_MURMUR3_H__
+#define __HASH_MURMUR3_H__
+
+#include <stdint.h>
+#include <unistd.h>
+
+/* MurmurHash3 (x86, 32-bit, seed 0) of str, up to its terminator or max
+ * bytes, whichever comes first; max < 0 means no limit.  Takes the string
+ * four bytes at a time.
+ */
+uint32_t hash_murmur3(const uint8_t * str, ssize_t max);
+
+#endif
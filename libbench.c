@@ -0,0 +1,238 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "stm32f10x.h"
+#include "fio.h"
+#include "libbench.h"
+
+/* Calls timed in one go; few enough that a run stays well inside a tick. */
+#define LIBBENCH_REPS 8
+/* Runs of each case, of which the fastest counts. */
+#define LIBBENCH_RUNS 5
+#define LIBBENCH_MAX 1024
+/* Room for misalignment, and a guard byte either side. */
+#define LIBBENCH_PAD 8
+#define LIBBENCH_RANDS 64
+
+struct libbench_case_t {
+	char *dst;
+	char *src;
+	char *cmp;
+	int len;
+	int result;
+};
+
+typedef void (*libbench_fn)(struct libbench_case_t *c);
+
+static void run_empty(struct libbench_case_t *c)
+{
+}
+
+static void run_memcpy(struct libbench_case_t *c)
+{
+	memcpy(c->dst, c->src, c->len);
+}
+
+static void run_memset(struct libbench_case_t *c)
+{
+	memset(c->dst, 0x5A, c->len);
+}
+
+static void run_strlen(struct libbench_case_t *c)
+{
+	c->result = strlen(c->src);
+}
+
+static void run_strcmp(struct libbench_case_t *c)
+{
+	c->result = strcmp(c->src, c->cmp);
+}
+
+static void run_rand(struct libbench_case_t *c)
+{
+	int i, v;
+
+	for (i = 0; i < c->len; i++) {
+		v = rand();
+		if (v < 0 || v > RAND_MAX)
+			c->result = 1;
+	}
+}
+
+static void run_sprintf_int(struct libbench_case_t *c)
+{
+	c->result = sprintf(c->dst, "%d", -123456789);
+}
+
+static void run_sprintf_ls(struct libbench_case_t *c)
+{
+	c->result = sprintf(c->dst, " %s %u\n", "README", 4096u);
+}
+
+static void run_sprintf_hex(struct libbench_case_t *c)
+{
+	c->result = sprintf(c->dst, "%08x", 0xbeefu);
+}
+
+static void run_sprintf_long(struct libbench_case_t *c)
+{
+	c->result = sprintf(c->dst, "%lld", 1234567890123456789LL);
+}
+
+/* Core clocks taken by LIBBENCH_REPS calls of fn, off SysTick, which counts
+ * them down from LOAD every tick.  Interrupts stay off meanwhile, so the
+ * counter wraps at most once, and COUNTFLAG tells whether it did.
+ */
+static uint32_t libbench_time(libbench_fn fn, struct libbench_case_t *c)
+{
+	uint32_t best = UINT32_MAX;
+	uint32_t t0, t1, d;
+	int run, i;
+
+	for (run = 0; run < LIBBENCH_RUNS; run++) {
+		taskENTER_CRITICAL();
+		(void) SysTick->CTRL;
+		t0 = SysTick->VAL;
+		for (i = 0; i < LIBBENCH_REPS; i++)
+			fn(c);
+		t1 = SysTick->VAL;
+		d = t0 - t1;
+		if (SysTick->CTRL & SysTick_CTRL_COUNTFLAG_Msk)
+			d += SysTick->LOAD + 1;
+		taskEXIT_CRITICAL();
+		if (d < best)
+			best = d;
+	}
+
+	return best;
+}
+
+static uint32_t overhead;
+static int reported;
+
+/* Time fn on c once its result has been checked. */
+static void libbench_report(const char *name, int len, int dalign, int salign,
+                            libbench_fn fn, struct libbench_case_t *c, int ok)
+{
+	uint32_t t = libbench_time(fn, c);
+
+	t = t > overhead ? (t - overhead) / LIBBENCH_REPS : 0;
+	printf("%s{\"fn\":\"%s\",\"len\":%d,\"dst\":%d,\"src\":%d,"
+	       "\"cycles\":%u,\"ok\":%d}\n",
+	       reported++ ? "," : "", name, len, dalign, salign, (unsigned) t, ok);
+}
+
+/* Every byte of p[0..len) is c, and the guard bytes around it are 0. */
+static int libbench_filled(const char *p, int len, char c)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		if (p[i] != c)
+			return 0;
+	return !p[-1] && !p[len];
+}
+
+static void libbench_mem(char *dbuf, char *sbuf, int len, int dalign, int salign)
+{
+	struct libbench_case_t c = {
+		.dst = dbuf + 1 + dalign,
+		.src = sbuf + 1 + salign,
+		.len = len
+	};
+	int i, ok;
+
+	for (i = 0; i < len; i++)
+		c.src[i] = 1 + (i * 7 + dalign) % 251;
+	memset(dbuf, 0, LIBBENCH_MAX + LIBBENCH_PAD);
+	run_memcpy(&c);
+	ok = !c.dst[-1] && !c.dst[len];
+	for (i = 0; i < len; i++)
+		if (c.dst[i] != c.src[i])
+			ok = 0;
+	libbench_report("memcpy", len, dalign, salign, run_memcpy, &c, ok);
+
+	memset(dbuf, 0, LIBBENCH_MAX + LIBBENCH_PAD);
+	run_memset(&c);
+	libbench_report("memset", len, dalign, salign, run_memset, &c,
+	                libbench_filled(c.dst, len, 0x5A));
+}
+
+static void libbench_str(char *sbuf, char *cbuf, int len, int dalign, int salign)
+{
+	struct libbench_case_t c = {
+		.src = sbuf + 1 + salign,
+		.cmp = cbuf + 1 + dalign,
+		.len = len
+	};
+
+	/* Equal strings, the most either routine has to read. */
+	memset(c.src, 'a', len);
+	c.src[len] = '\0';
+	memcpy(c.cmp, c.src, len + 1);
+
+	run_strlen(&c);
+	libbench_report("strlen", len, dalign, salign, run_strlen, &c, c.result == len);
+	run_strcmp(&c);
+	libbench_report("strcmp", len, dalign, salign, run_strcmp, &c, c.result == 0);
+}
+
+void libbench_run()
+{
+	static const int sizes[] = { 4, 16, 64, 256, LIBBENCH_MAX };
+	/* Destination and source misalignment; equal ones allow word copies. */
+	static const int aligns[][2] = { {0, 0}, {1, 1}, {0, 1}, {1, 0}, {2, 3} };
+	static const struct {
+		const char *name;
+		libbench_fn fn;
+		const char *expect;
+	} formats[] = {
+		{ "sprintf %d", run_sprintf_int, "-123456789" },
+		{ "sprintf %s %u", run_sprintf_ls, " README 4096\n" },
+		{ "sprintf %08x", run_sprintf_hex, "0000beef" },
+		{ "sprintf %lld", run_sprintf_long, "1234567890123456789" },
+	};
+	struct libbench_case_t c = {0};
+	char *dbuf = pvPortMalloc(LIBBENCH_MAX + LIBBENCH_PAD);
+	char *sbuf = pvPortMalloc(LIBBENCH_MAX + LIBBENCH_PAD);
+	int i, j, len;
+
+	if (!dbuf || !sbuf) {
+		fio_write(2, "bench: out of memory\n", 21);
+		vPortFree(dbuf);
+		vPortFree(sbuf);
+		return;
+	}
+
+	overhead = libbench_time(run_empty, &c);
+	reported = 0;
+	printf("{\"hz\":%u,\"cases\":[\n", (unsigned) configCPU_CLOCK_HZ);
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		for (j = 0; j < sizeof(aligns) / sizeof(aligns[0]); j++)
+			libbench_mem(dbuf, sbuf, sizes[i], aligns[j][0], aligns[j][1]);
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		for (j = 0; j < sizeof(aligns) / sizeof(aligns[0]); j++)
+			libbench_str(sbuf, dbuf, sizes[i], aligns[j][0], aligns[j][1]);
+
+	c.dst = dbuf;
+	for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+		formats[i].fn(&c);
+		len = strlen(formats[i].expect);
+		libbench_report(formats[i].name, len, 0, 0, formats[i].fn, &c,
+		                c.result == len && !strcmp(dbuf, formats[i].expect));
+	}
+
+	c.len = LIBBENCH_RANDS;
+	c.result = 0;
+	run_rand(&c);
+	libbench_report("rand", LIBBENCH_RANDS, 0, 0, run_rand, &c, !c.result);
+	printf("]}\n");
+
+	vPortFree(dbuf);
+	vPortFree(sbuf);
+}
@@ -0,0 +1,12 @@
+#ifndef LIBBENCH_H
+#define LIBBENCH_H
+
+/* Cycle counts of the libc routines on the target, for "bench libc".
+ * Prints one JSON object: the core clock and a case per line with the
+ * routine, length, destination and source misalignment, cycles per call
+ * and whether the result checked out.  The length is in bytes, of output
+ * for sprintf, and in calls for rand.
+ */
+void libbench_run();
+
+#endif
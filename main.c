@@ -1,6 +1,7 @@
 #define USE_STDPERIPH_DRIVER
 #include "stm32f10x.h"
 #include "serial_io.h"
+#include "console.h"
 
 /* Scheduler includes. */
 #include "FreeRTOS.h"
@@ -11,10 +12,15 @@
 #include "filesystem.h"
 #include "fio.h"
 #include "romfs.h"
+#include "overlayfs.h"
+#include "hash-paths.h"
 
 /* Shell includes */
 #include "shell.h"
 
+/* File transfer service */
+#include "xfer.h"
+
 extern const uint8_t _sromfs;
 
 int main()
@@ -24,13 +30,24 @@ int main()
 	fs_init();
 	fio_init();
 
-	register_romfs("romfs", &_sromfs);
+	/* Files written at run time shadow the flash image. */
+	register_overlayfs("romfs", romfs_mount_hash, &_sromfs);
+
+	/* Create the task that owns console output. */
+	xTaskCreate(console_task,
+	            (const signed portCHAR *) "Console",
+	            128 /* stack size */, NULL, tskIDLE_PRIORITY + 3, NULL);
 
 	/* Create a task to output text read from romfs. */
 	xTaskCreate(shell_task,
 	            (const signed portCHAR *) "Shell",
 	            1024 /* stack size */, NULL, tskIDLE_PRIORITY + 2, NULL);
 
+	/* Create a task to serve file transfers over a framed serial link. */
+	xTaskCreate(xfer_task,
+	            (const signed portCHAR *) "Xfer",
+	            256 /* stack size */, NULL, tskIDLE_PRIORITY + 1, NULL);
+
 	/* Start running the tasks. */
 	vTaskStartScheduler();
 
@@ -1,14 +1,8 @@
-#include <limits.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include "FreeRTOS.h"
-
-#define ALIGN (sizeof(size_t))
-#define ONES ((size_t)-1/UCHAR_MAX)
-#define HIGHS (ONES * (UCHAR_MAX/2+1))
-#define HASZERO(x) ((x)-ONES & ~(x) & HIGHS)
-#define SS (sizeof(size_t))
+#include "word-util.h"
 
 void free(void *p)
 {
@@ -20,45 +14,215 @@ void *malloc(size_t size)
 	return pvPortMalloc(size);
 }
 
+/* Block loops moving 32 bytes per LDM/STM pair; blocks must be nonzero.
+ * The loops are written in assembly since the firmware is built without
+ * optimisation.  Elsewhere (the host tests) they are plain C.
+ */
+#ifdef __thumb2__
+#define BURST_REGS "{r3-r6, r8-r10, r12}"
+#define BURST_CLOBBERS "r3", "r4", "r5", "r6", "r8", "r9", "r10", "r12", "cc", "memory"
+
+#define COPY_BLOCKS(d, s, blocks) \
+	asm volatile("1: ldmia %1!, " BURST_REGS "\n" \
+	             "   stmia %0!, " BURST_REGS "\n" \
+	             "   subs %2, %2, #1\n" \
+	             "   bne 1b\n" \
+	             : "+r" (d), "+r" (s), "+r" (blocks) : : BURST_CLOBBERS)
+
+#define COPY_BLOCKS_BACK(d, s, blocks) \
+	asm volatile("1: ldmdb %1!, " BURST_REGS "\n" \
+	             "   stmdb %0!, " BURST_REGS "\n" \
+	             "   subs %2, %2, #1\n" \
+	             "   bne 1b\n" \
+	             : "+r" (d), "+r" (s), "+r" (blocks) : : BURST_CLOBBERS)
+
+#define FILL_BLOCKS(d, k, blocks) \
+	asm volatile("   mov r3, %2\n   mov r4, %2\n   mov r5, %2\n   mov r6, %2\n" \
+	             "   mov r8, %2\n   mov r9, %2\n   mov r10, %2\n   mov r12, %2\n" \
+	             "1: stmia %0!, " BURST_REGS "\n" \
+	             "   subs %1, %1, #1\n" \
+	             "   bne 1b\n" \
+	             : "+r" (d), "+r" (blocks) : "r" (k) : BURST_CLOBBERS)
+#else
+#define COPY_BLOCKS(d, s, blocks) \
+	do { \
+		int i_; \
+		for (; blocks; blocks--) \
+			for (i_ = 0; i_ < 8; i_++) \
+				*d++ = *s++; \
+	} while (0)
+
+#define COPY_BLOCKS_BACK(d, s, blocks) \
+	do { \
+		int i_; \
+		for (; blocks; blocks--) \
+			for (i_ = 0; i_ < 8; i_++) \
+				*--d = *--s; \
+	} while (0)
+
+#define FILL_BLOCKS(d, k, blocks) \
+	do { \
+		int i_; \
+		for (; blocks; blocks--) \
+			for (i_ = 0; i_ < 8; i_++) \
+				*d++ = k; \
+	} while (0)
+#endif
+
 void *memset(void *dest, int c, size_t n)
 {
 	unsigned char *s = (unsigned char*)dest;
+	uint32_t *w;
+	uint32_t k, blocks;
 
 	c = (unsigned char)c;
-	for (; ((uintptr_t)s & ALIGN) && n; n--)
+	for (; ((uintptr_t)s % 4) && n; n--)
 		*s++ = c;
-	if (n) {
-		size_t *w, k = ONES * c;
-
-		for (w = (void *)s; n>=SS; n-=SS, w++)
-			*w = k;
-		for (s = (void *)w; n; n--, s++)
-			*s = c;
+	if (n >= 4) {
+		k = 0x01010101u * c;
+		w = (void *)s;
+		if ((blocks = n / 32)) {
+			FILL_BLOCKS(w, k, blocks);
+			n %= 32;
+		}
+		for (; n >= 4; n -= 4)
+			*w++ = k;
+		s = (void *)w;
 	}
+	for (; n; n--)
+		*s++ = c;
 
 	return dest;
 }
 
+void *memchr(const void *src, int c, size_t n)
+{
+	const unsigned char *s = src;
+
+	c = (unsigned char)c;
+	for (; ((uintptr_t)s % ALIGN) && n && *s != c; s++, n--);
+	if (n && *s != c) {
+		const word_t *w;
+		size_t k = ONES * c;
+
+		for (w = (const void *)s; n >= SS && !HASZERO(*w ^ k); w++, n -= SS);
+		s = (const void *)w;
+	}
+	for (; n && *s != c; s++, n--);
+
+	return n ? (void *)s : NULL;
+}
+
+/* Up to 16 bytes, everything loaded before anything is stored, so it also
+ * serves overlapping moves.  Queue items are mostly this size.
+ */
+static void move_small(unsigned char *d, const unsigned char *s, size_t n)
+{
+	uint32_t a, b, c, e;
+
+	if (n >= 8) {
+		a = LOAD32(s);
+		b = LOAD32(s + 4);
+		c = LOAD32(s + n - 8);
+		e = LOAD32(s + n - 4);
+		STORE32(d, a);
+		STORE32(d + 4, b);
+		STORE32(d + n - 8, c);
+		STORE32(d + n - 4, e);
+	}
+	else if (n >= 4) {
+		a = LOAD32(s);
+		b = LOAD32(s + n - 4);
+		STORE32(d, a);
+		STORE32(d + n - 4, b);
+	}
+	else if (n) {
+		a = s[0];
+		b = s[n / 2];
+		c = s[n - 1];
+		d[0] = a;
+		d[n / 2] = b;
+		d[n - 1] = c;
+	}
+}
+
+/* Copies forwards, so it also serves memmove() when dest is below src. */
 void *memcpy(void *dest, const void *src, size_t n)
 {
-	void *ret = dest;
-
-	//Cut rear
-	uint8_t *dst8 = dest;
-	const uint8_t *src8 = src;
-	switch (n % 4) {
-		case 3 : *dst8++ = *src8++;
-		case 2 : *dst8++ = *src8++;
-		case 1 : *dst8++ = *src8++;
-		case 0 : ;
+	unsigned char *d = dest;
+	const unsigned char *s = src;
+	uint32_t *dw;
+	const uint32_t *sw;
+	uint32_t blocks;
+
+	if (n <= 16) {
+		move_small(d, s, n);
+		return dest;
 	}
 
-	//stm32 data bus width
-	uint32_t *dst32 = (void *)dst8;
-	const uint32_t *src32 = (void *)src8;
-	n >>= 2;
-	while (n--)
-		*dst32++ = *src32++;
+	for (; (uintptr_t)d % 4; n--)
+		*d++ = *s++;
+	dw = (void *)d;
+	if ((uintptr_t)s % 4 == 0) {
+		sw = (const void *)s;
+		if ((blocks = n / 32)) {
+			COPY_BLOCKS(dw, sw, blocks);
+			n %= 32;
+		}
+		for (; n >= 4; n -= 4)
+			*dw++ = *sw++;
+		s = (const void *)sw;
+	}
+	else {
+		/* LDM needs alignment; single loads do not. */
+		for (; n >= 4; n -= 4, s += 4)
+			*dw++ = LOAD32(s);
+	}
+	for (d = (void *)dw; n; n--)
+		*d++ = *s++;
 
-	return ret;
+	return dest;
+}
+
+void *memmove(void *dest, const void *src, size_t n)
+{
+	unsigned char *d = dest;
+	const unsigned char *s = src;
+	uint32_t *dw;
+	const uint32_t *sw;
+	uint32_t blocks;
+
+	if (n <= 16) {
+		move_small(d, s, n);
+		return dest;
+	}
+	if (d <= s || d >= s + n)
+		return memcpy(dest, src, n);
+
+	/* dest overlaps the end of src: copy backwards. */
+	d += n;
+	s += n;
+	for (; (uintptr_t)d % 4; n--)
+		*--d = *--s;
+	dw = (void *)d;
+	if ((uintptr_t)s % 4 == 0) {
+		sw = (const void *)s;
+		if ((blocks = n / 32)) {
+			COPY_BLOCKS_BACK(dw, sw, blocks);
+			n %= 32;
+		}
+		for (; n >= 4; n -= 4)
+			*--dw = *--sw;
+		s = (const void *)sw;
+	}
+	else {
+		for (; n >= 4; n -= 4) {
+			s -= 4;
+			*--dw = LOAD32(s);
+		}
+	}
+	for (d = (void *)dw; n; n--)
+		*--d = *--s;
+
+	return dest;
 }
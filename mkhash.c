@@ -0,0 +1,58 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "hash-djb2.h"
+#include "hash-murmur3.h"
+
+/* Writes a header of hash values for the names given, computed by the
+ * firmware's own hash code, so that hashed names need no hand-typed
+ * constants and are not hashed again at run time.  Names before -m are
+ * devfs file names, hashed with hash_djb2() as devfs_open() does, and
+ * become <name>_hash.  Names after it are mount points, hashed with
+ * hash_murmur3() as filesystem.c does, and become <name>_mount_hash.
+ * Characters that cannot be in an identifier are turned into '_'.
+ */
+
+void usage(const char * binname) {
+    printf("Usage: %s <name>... [-m <mount point>...] > header\n", binname);
+    exit(-1);
+}
+
+int main(int argc, char ** argv) {
+    char * binname = *argv++;
+    int mount = 0;
+    uint32_t hash;
+    char * o;
+    const char * p;
+
+    if (argc < 2)
+        usage(binname);
+
+    printf("/* Generated by mkhash, do not edit. */\n");
+    printf("#ifndef __HASH_PATHS_H__\n");
+    printf("#define __HASH_PATHS_H__\n\n");
+
+    while ((o = *argv++)) {
+        if (!strcmp(o, "-m")) {
+            mount = 1;
+            continue;
+        }
+        if (mount)
+            hash = hash_murmur3((const uint8_t *) o, -1);
+        else
+            hash = hash_djb2((const uint8_t *) o, -1);
+
+        printf("#define ");
+        if (isdigit((unsigned char) *o))
+            putchar('_');
+        for (p = o; *p; p++)
+            putchar(isalnum((unsigned char) *p) ? *p : '_');
+        printf("%s 0x%08X /* \"%s\" */\n", mount ? "_mount_hash" : "_hash", (unsigned) hash, o);
+    }
+
+    printf("\n#endif\n");
+
+    return 0;
+}
@@ -8,9 +8,13 @@
 #include <stdint.h>
 #include <dirent.h>
 #include <string.h>
+#include "hash-murmur3.h"
+#include "romfs.h"
 
 #define hash_init 5381
 
+static int hash_kind = ROMFS_HASH_MURMUR3;
+
 uint32_t hash_djb2(const uint8_t * str, uint32_t hash) {
     int c;
 
@@ -20,17 +24,30 @@ uint32_t hash_djb2(const uint8_t * str, uint32_t hash) {
     return hash;
 }
 
+/* The hash of path within the image, as romfs_hash() computes it. */
+uint32_t hash_path(const char * path) {
+    if (hash_kind == ROMFS_HASH_MURMUR3)
+        return hash_murmur3((const uint8_t *) path, -1);
+    return hash_djb2((const uint8_t *) path, hash_init);
+}
+
+void write_u32(uint32_t w, FILE * outfile) {
+    uint8_t b[4] = { w & 0xff, (w >> 8) & 0xff, (w >> 16) & 0xff, (w >> 24) & 0xff };
+
+    fwrite(b, 1, 4, outfile);
+}
+
 void usage(const char * binname) {
-    printf("Usage: %s [-d <dir>] [outfile]\n", binname);
+    printf("Usage: %s [-d <dir>] [-H djb2|murmur3] [outfile]\n", binname);
     exit(-1);
 }
 
 void processdir(DIR * dirp, const char * curpath, FILE * outfile, const char * prefix) {
     char fullpath[1024];
+    char path[1024];
     char buf[16 * 1024];
     struct dirent * ent;
     DIR * rec_dirp;
-    uint32_t cur_hash = hash_djb2((const uint8_t *) curpath, hash_init);
     uint32_t size, w, hash;
     uint32_t mode;
     uint8_t b;
@@ -58,7 +75,9 @@ void processdir(DIR * dirp, const char * curpath, FILE * outfile, const char * p
             struct stat status;
 
             stat(fullpath, &status);
-            hash = hash_djb2((const uint8_t *) ent->d_name, cur_hash);
+            strcpy(path, curpath);
+            strcat(path, ent->d_name);
+            hash = hash_path(path);
             infile = fopen(fullpath, "rb");
             if (!infile) {
                 perror("opening input file");
@@ -106,6 +125,15 @@ int main(int argc, char ** argv) {
             case 'd':
                 dirname = *argv++;
                 break;
+            case 'H':
+                o = *argv++;
+                if (o && !strcmp(o, "djb2"))
+                    hash_kind = ROMFS_HASH_DJB2;
+                else if (o && !strcmp(o, "murmur3"))
+                    hash_kind = ROMFS_HASH_MURMUR3;
+                else
+                    usage(binname);
+                break;
             default:
                 usage(binname);
                 break;
@@ -133,6 +161,12 @@ int main(int argc, char ** argv) {
         exit(-1);
     }
 
+    /* The header: an entry with no name, holding the hash in its mode. */
+    write_u32(ROMFS_MAGIC, outfile);
+    fputc(0, outfile);
+    write_u32(hash_kind, outfile);
+    write_u32(0, outfile);
+
     processdir(dirp, "", outfile, dirname);
     fwrite(&z, 1, 8, outfile);
     if (outname)
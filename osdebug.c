@@ -3,8 +3,13 @@
 #include <stdlib.h>
 
 #include "FreeRTOS.h"
+#include "task.h"
+#include "stm32f10x.h"
+#include "fio.h"
 #include "osdebug.h"
+#include "random-util.h"
 #include "serial_io.h"
+#include "string-util.h"
 
 #define ALLOC_SIZE_MASK 0x7FF
 #define MIN_ALLOC_SIZE 256
@@ -37,72 +42,84 @@ void mmtest_task(void * pvParameters)
     unsigned int write_pointer = 0;
     unsigned int read_pointer = 0;
     int record[RECORD_INDEX_OF(ALLOC_SIZE_MASK) + 1][2] = {0};
+    unsigned char chunk[32];
+    unsigned int seed;
+    unsigned int fill;
     int i;
     int size;
     char *p;
     char c;
+    int mode;
+    int raw;
 
-    srand(xTaskGetTickCount());
+    /* Take single keys as they are typed rather than whole lines. */
+    fio_ioctl(0, FIO_TCGETS, &mode);
+    raw = mode & ~(SERIAL_ICANON | SERIAL_ECHO);
+    fio_ioctl(0, FIO_TCSETS, &raw);
+
+    // sizes come from a state of our own, so other tasks using rand()
+    // neither disturb it nor get disturbed
+    seed = rand_entropy() ^ xTaskGetTickCount();
     for (;;) {
         do {
-            i = rand();
+            i = rand_r(&seed);
             size = i & ALLOC_SIZE_MASK;
         } while (size < MIN_ALLOC_SIZE);
-        printf("try to allocate %d bytes\n", size);
+        PRINTF_CONST("try to allocate %d bytes\n", size);
         p = (char*)malloc(size);
-        printf("malloc returned %p\n", p);
+        PRINTF_CONST("malloc returned %p\n", p);
         if (p == NULL) {
             // can't do new allocations until we free some old ones
             while (circbuf_size(read_pointer, write_pointer) > 0) {
                 // confirm that data didn't get trampled before freeing
                 mmtest_slot foo = read_cb(slots, &read_pointer, write_pointer);
                 p = foo.pointer;
-                // reset the PRNG to its state for random data
-                srand(foo.prng_state);
+                // fill again from the block's state, a chunk at a time
+                fill = foo.prng_state;
                 size = foo.size;
-                printf("free a block, size %d\n", size);
+                PRINTF_CONST("free a block, size %d\n", size);
                 for (i = 0; i < size; i++) {
+                    if (i % sizeof(chunk) == 0)
+                        rand_fill_r(&fill, chunk, size - i < sizeof(chunk) ? size - i : sizeof(chunk));
                     unsigned char u = p[i];
-                    unsigned char v = (unsigned char) rand();
+                    unsigned char v = chunk[i % sizeof(chunk)];
                     if (u != v) {
                         printf("OUCH: u=%02x, v=%02x\n", u, v);
-                        return;
+                        goto out;
                     }
                 }
                 free(p);
-                if ((rand() & 1) == 0)
+                if ((rand_r(&seed) & 1) == 0)
                     break;
             }
             record[RECORD_INDEX_OF(size)][1]++;
         }
         else {
-            printf("allocate a block, size %d\n", size);
+            PRINTF_CONST("allocate a block, size %d\n", size);
             if (circbuf_size(read_pointer, write_pointer) == CIRCBUFSIZE - 1) {
                 fio_write(2, "circular buffer overflow\n", 25);
-                return;
+                goto out;
             }
             slots[write_pointer++] = (mmtest_slot){.pointer=p, .size=size, .prng_state=i};
             write_pointer %= CIRCBUFSIZE;
-            srand(i);
-            for (i = 0; i < size; i++) {
-                p[i] = (unsigned char) rand();
-            }
+            fill = i;
+            rand_fill_r(&fill, p, size);
             record[RECORD_INDEX_OF(size)][0]++;
         }
-        c = recv_byte(&i);
-        if (i == pdTRUE) {
+        if (fio_ioctl(0, FIO_NREAD, &i) == 0 && i > 0) {
+            fio_read(0, &c, 1);
             if (tolower(c) == 'x')
-                return;
+                break;
             puts("  Range   Success Failure\n");
             for (i = 0; i < sizeof(record) / sizeof(record[0]); i++) {
                 int j = MIN_ALLOC_SIZE + i * RANGE_PER_RECORD;
                 printf("%4d~%4d %7d %7d\n", j, j + RANGE_PER_RECORD - 1, record[i][0], record[i][1]);
             }
             puts("(x: exit; other key to continue)");
-            c = recv_byte(NULL);
+            fio_read(0, &c, 1);
             puts("\n");
             if (tolower(c) == 'x')
-                return;
+                break;
         }
     }
 
@@ -111,6 +128,128 @@ void mmtest_task(void * pvParameters)
 
         free(foo.pointer);
     }
+
+out:
+    fio_ioctl(0, FIO_TCSETS, &mode);
+}
+
+struct dbg_record_t {
+    /* One more than the sequence number of the record held, so that 0 is
+     * a record never written; DBG_BUSY while being written.
+     */
+    volatile uint32_t seq;
+    const char * fmt;
+    portTickType ticks;
+    uint32_t arg[DBG_ARGS];
+    /* Set when arg[2] onwards hold a string copied by dbg_record_str(). */
+    uint8_t str;
+};
+
+#define DBG_BUSY 0xFFFFFFFF
+
+static struct dbg_record_t dbg_ring[DBG_RECORDS];
+/* Next sequence number to hand out, and next one to print. */
+static volatile uint32_t dbg_head = 0;
+static uint32_t dbg_tail = 0;
+static uint32_t dbg_lost = 0;
+
+/* Claim the next record and mark it busy; there is no lock, interrupts
+ * may log in between.  *seq is set to its sequence number.
+ */
+static struct dbg_record_t * dbg_claim(const char * fmt, uint32_t * seq)
+{
+    struct dbg_record_t * r;
+
+    do {
+        *seq = __LDREXW((uint32_t *) &dbg_head);
+    } while (__STREXW(*seq + 1, (uint32_t *) &dbg_head));
+
+    r = &dbg_ring[*seq & (DBG_RECORDS - 1)];
+    r->seq = DBG_BUSY;
+    __DMB();
+    r->fmt = fmt;
+    r->ticks = xTaskGetTickCountFromISR();
+    return r;
+}
+
+static void dbg_commit(struct dbg_record_t * r, uint32_t seq)
+{
+    __DMB();
+    r->seq = seq + 1;
+}
+
+void dbg_record(const char * fmt, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4)
+{
+    uint32_t seq;
+    struct dbg_record_t * r = dbg_claim(fmt, &seq);
+
+    r->arg[0] = a0;
+    r->arg[1] = a1;
+    r->arg[2] = a2;
+    r->arg[3] = a3;
+    r->arg[4] = a4;
+    r->str = 0;
+    dbg_commit(r, seq);
 }
 
-void osDbgPrintf(const char * fmt, ...) { }
+void dbg_record_str(const char * fmt, const char * str, uint32_t a0, uint32_t a1)
+{
+    uint32_t seq;
+    struct dbg_record_t * r = dbg_claim(fmt, &seq);
+    char * copy = (char *) &r->arg[2];
+    int i;
+
+    r->arg[0] = a0;
+    r->arg[1] = a1;
+    for (i = 0; i < DBG_STR - 1 && str[i]; i++)
+        copy[i] = str[i];
+    copy[i] = '\0';
+    r->str = 1;
+    dbg_commit(r, seq);
+}
+
+int dbg_dump()
+{
+    uint32_t head = dbg_head;
+    struct dbg_record_t r;
+    struct dbg_record_t * p;
+    int n = 0;
+
+    if (head - dbg_tail > DBG_RECORDS) {
+        dbg_lost += head - dbg_tail - DBG_RECORDS;
+        dbg_tail = head - DBG_RECORDS;
+    }
+
+    for (; dbg_tail != head; dbg_tail++) {
+        p = &dbg_ring[dbg_tail & (DBG_RECORDS - 1)];
+        /* Stop at a record still being written; it is printed next time. */
+        if (p->seq == DBG_BUSY)
+            break;
+
+        r = *p;
+        __DMB();
+        /* A writer that claimed this record may not have marked it busy
+         * yet, leaving an older one in place; wait for it too.
+         */
+        if ((int32_t) (r.seq - (dbg_tail + 1)) < 0)
+            break;
+        if (r.seq != dbg_tail + 1 || p->seq != dbg_tail + 1) {
+            /* Overwritten by a newer record while we were behind. */
+            dbg_lost++;
+            continue;
+        }
+
+        printf("[%u] ", (unsigned) r.ticks);
+        if (r.str)
+            printf(r.fmt, (const char *) &r.arg[2], r.arg[0], r.arg[1]);
+        else
+            printf(r.fmt, r.arg[0], r.arg[1], r.arg[2], r.arg[3], r.arg[4]);
+        n++;
+    }
+
+    if (dbg_lost) {
+        printf("(%u records lost)\n", (unsigned) dbg_lost);
+        dbg_lost = 0;
+    }
+    return n;
+}
@@ -1,10 +1,42 @@
 #ifndef __OSDEBUG_H__
 #define __OSDEBUG_H__
 
+#include <stdint.h>
+
 void mmtest_task(void * pvParameters);
 
-void osDbgPrintf(const char * fmt, ...);
+/* Deferred debug log.  DBGOUT stores the format pointer, the tick count and
+ * up to DBG_ARGS argument words in a RAM ring, and formats nothing; the
+ * records are printed later by dbg_dump() (the shell's "dmesg").  It may be
+ * called from interrupt handlers.  Every argument must fit in a word, and
+ * %s arguments are read only when the log is dumped, so they should still
+ * be valid then; DBGOUT_STR is for strings that will not be.
+ */
+#define DBG_RECORDS 32   /* power of two */
+#define DBG_ARGS 5
+
+void dbg_record(const char * fmt, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4);
+
+/* Like DBGOUT for a format whose first conversion is the %s of a string
+ * that may be gone by the time of the dump, such as a path being opened.
+ * Its first DBG_STR - 1 bytes are copied into the record, in the place of
+ * all but two argument words.
+ */
+#define DBG_STR ((DBG_ARGS - 2) * 4)
+
+void dbg_record_str(const char * fmt, const char * str, uint32_t a0, uint32_t a1);
+
+/* Print the records logged since the last dump, oldest first, and say how
+ * many were overwritten before they could be.  Returns the number printed.
+ */
+int dbg_dump();
+
+#define DBGOUT(...) DBGOUT_(__VA_ARGS__, 0, 0, 0, 0, 0, 0)
+#define DBGOUT_(fmt, a0, a1, a2, a3, a4, ...) \
+    dbg_record(fmt, DBG_WORD(a0), DBG_WORD(a1), DBG_WORD(a2), DBG_WORD(a3), DBG_WORD(a4))
+#define DBG_WORD(x) ((uint32_t) (uintptr_t) (x))
 
-#define DBGOUT osDbgPrintf
+#define DBGOUT_STR(...) DBGOUT_STR_(__VA_ARGS__, 0, 0, 0)
+#define DBGOUT_STR_(fmt, str, a0, a1, ...) dbg_record_str(fmt, str, DBG_WORD(a0), DBG_WORD(a1))
 
 #endif
@@ -0,0 +1,527 @@
+#include <errno.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <semphr.h>
+#include <unistd.h>
+#include "fio.h"
+#include "filesystem.h"
+#include "overlayfs.h"
+#include "romfs.h"
+#include "osdebug.h"
+
+/* A file of the writable upper layer, kept in RAM.  Entries are never
+ * removed from the list: deleting a file turns its entry into a whiteout,
+ * which hides the lower copy until a later O_CREAT revives it.
+ */
+struct overlay_file_t {
+    struct overlay_file_t * next;
+    uint32_t hash;
+    uint32_t mode;
+    size_t size;
+    size_t capacity;
+    uint8_t * data;
+    int refs;
+    int whiteout;
+    char name[1];
+};
+
+/* neg_valid holds a bit per slot. */
+#if OVERLAY_NEG_CACHE > 32
+#error OVERLAY_NEG_CACHE must be at most 32
+#endif
+
+struct overlay_t {
+    const uint8_t * lower;
+    struct overlay_file_t * upper;
+    /* Hashes known to be absent from the upper layer; one valid bit each. */
+    uint32_t neg_hash[OVERLAY_NEG_CACHE];
+    uint32_t neg_valid;
+};
+
+struct overlay_fds_t {
+    struct overlay_file_t * upper;
+    const uint8_t * lower;
+    uint32_t cursor;
+    int flags;
+};
+
+struct overlay_iter_t {
+    struct overlay_t * ovl;
+    struct overlay_file_t * upper;
+    const uint8_t * lower;
+    file_attr_t next;
+    int valid;
+};
+
+static xSemaphoreHandle overlay_sem = NULL;
+static struct overlay_iter_t overlay_iter;
+
+static uint32_t get_unaligned(const uint8_t * d) {
+    return ((uint32_t) d[0]) | ((uint32_t) (d[1] << 8)) | ((uint32_t) (d[2] << 16)) | ((uint32_t) (d[3] << 24));
+}
+
+static int overlay_neg_lookup(struct overlay_t * o, uint32_t h) {
+    int i = h % OVERLAY_NEG_CACHE;
+
+    return (o->neg_valid & (1u << i)) && (o->neg_hash[i] == h);
+}
+
+static void overlay_neg_insert(struct overlay_t * o, uint32_t h) {
+    int i = h % OVERLAY_NEG_CACHE;
+
+    o->neg_hash[i] = h;
+    o->neg_valid |= 1u << i;
+}
+
+static void overlay_neg_forget(struct overlay_t * o, uint32_t h) {
+    if (overlay_neg_lookup(o, h))
+        o->neg_valid &= ~(1u << (h % OVERLAY_NEG_CACHE));
+}
+
+/* Look a hash up in the upper layer; must hold overlay_sem. */
+static struct overlay_file_t * overlay_find(struct overlay_t * o, uint32_t h) {
+    struct overlay_file_t * f;
+
+    if (overlay_neg_lookup(o, h))
+        return NULL;
+
+    for (f = o->upper; f; f = f->next) {
+        if (f->hash == h)
+            return f;
+    }
+
+    overlay_neg_insert(o, h);
+    return NULL;
+}
+
+static struct overlay_file_t * overlay_create(struct overlay_t * o, uint32_t h, const char * name, uint32_t mode) {
+    struct overlay_file_t * f = malloc(sizeof(struct overlay_file_t) + strlen(name));
+
+    if (!f) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    memset(f, 0, sizeof(struct overlay_file_t));
+    f->hash = h;
+    f->mode = mode;
+    strcpy(f->name, name);
+    f->next = o->upper;
+    o->upper = f;
+    overlay_neg_forget(o, h);
+
+    return f;
+}
+
+static int overlay_reserve(struct overlay_file_t * f, size_t size) {
+    size_t capacity = f->capacity ? f->capacity : 32;
+    uint8_t * data;
+
+    if (size <= f->capacity)
+        return 0;
+
+    while (capacity < size)
+        capacity += capacity < OVERLAY_GROW_MAX ? capacity : OVERLAY_GROW_MAX;
+
+    /* Old and new copies are both live here; the slack is only worth
+     * having if it fits.
+     */
+    data = malloc(capacity);
+    if (!data && capacity > size) {
+        capacity = size;
+        data = malloc(capacity);
+    }
+    if (!data) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if (f->data) {
+        memcpy(data, f->data, f->size);
+        free(f->data);
+    }
+    f->data = data;
+    f->capacity = capacity;
+
+    return 0;
+}
+
+static void overlay_truncate(struct overlay_file_t * f) {
+    if (f->data)
+        free(f->data);
+    f->data = NULL;
+    f->size = 0;
+    f->capacity = 0;
+}
+
+static uint32_t overlay_new_mode(int mode) {
+    return S_IFREG | (mode ? (mode & 0777) : 0644);
+}
+
+static int overlay_access(uint32_t mode, int flags) {
+    int root = !strcmp(getenv("USER"), "root");
+
+    if (!(flags & O_WRONLY) && !(mode & (root ? S_IRUSR : S_IROTH)))
+        return 0;
+    if ((flags & (O_WRONLY | O_RDWR)) && !(mode & (root ? S_IWUSR : S_IWOTH)))
+        return 0;
+    return 1;
+}
+
+static size_t overlay_size(struct overlay_fds_t * fds) {
+    if (fds->upper)
+        return fds->upper->size;
+    return get_unaligned(fds->lower - 4);
+}
+
+static ssize_t overlay_pread(void * opaque, void * buf, size_t count, off_t offset) {
+    struct overlay_fds_t * fds = (struct overlay_fds_t *) opaque;
+    const uint8_t * data;
+    size_t size;
+
+    if (offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    xSemaphoreTake(overlay_sem, portMAX_DELAY);
+    data = fds->upper ? fds->upper->data : fds->lower;
+    size = overlay_size(fds);
+    if (offset >= size)
+        count = 0;
+    else if ((offset + count) > size)
+        count = size - offset;
+    memcpy(buf, data + offset, count);
+    xSemaphoreGive(overlay_sem);
+
+    return count;
+}
+
+/* Write count bytes at *offset, or at the end of the file if append is set,
+ * taking the size under the lock so that appenders do not overwrite one
+ * another.  *offset is left where the data went.
+ */
+static ssize_t overlay_put(struct overlay_fds_t * fds, const void * buf, size_t count, off_t * offset, int append) {
+    struct overlay_file_t * f = fds->upper;
+    size_t end;
+
+    if (*offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    xSemaphoreTake(overlay_sem, portMAX_DELAY);
+    if (append)
+        *offset = f->size;
+    end = *offset + count;
+    if (overlay_reserve(f, end) < 0) {
+        xSemaphoreGive(overlay_sem);
+        return -1;
+    }
+    if (*offset > f->size)
+        memset(f->data + f->size, 0, *offset - f->size);
+    memcpy(f->data + *offset, buf, count);
+    if (end > f->size)
+        f->size = end;
+    xSemaphoreGive(overlay_sem);
+
+    return count;
+}
+
+static ssize_t overlay_pwrite(void * opaque, const void * buf, size_t count, off_t offset) {
+    return overlay_put((struct overlay_fds_t *) opaque, buf, count, &offset, 0);
+}
+
+static ssize_t overlay_read(void * opaque, void * buf, size_t count) {
+    struct overlay_fds_t * fds = (struct overlay_fds_t *) opaque;
+    ssize_t r = overlay_pread(opaque, buf, count, fds->cursor);
+
+    if (r > 0)
+        fds->cursor += r;
+
+    return r;
+}
+
+static ssize_t overlay_write(void * opaque, const void * buf, size_t count) {
+    struct overlay_fds_t * fds = (struct overlay_fds_t *) opaque;
+    off_t offset = fds->cursor;
+    ssize_t r;
+
+    r = overlay_put(fds, buf, count, &offset, fds->flags & O_APPEND);
+    if (r > 0)
+        fds->cursor = offset + r;
+
+    return r;
+}
+
+static off_t overlay_seek(void * opaque, off_t offset, int whence) {
+    struct overlay_fds_t * fds = (struct overlay_fds_t *) opaque;
+    uint32_t size = overlay_size(fds);
+    uint32_t origin;
+
+    switch (whence) {
+    case SEEK_SET:
+        origin = 0;
+        break;
+    case SEEK_CUR:
+        origin = fds->cursor;
+        break;
+    case SEEK_END:
+        origin = size;
+        break;
+    default:
+        return -1;
+    }
+
+    offset = origin + offset;
+
+    if (offset < 0)
+        return -1;
+    /* Only upper files may grow by seeking past their end. */
+    if (!fds->upper && (offset > size))
+        offset = size;
+
+    fds->cursor = offset;
+
+    return offset;
+}
+
+static int overlay_close(void * opaque) {
+    struct overlay_fds_t * fds = (struct overlay_fds_t *) opaque;
+    struct overlay_file_t * f = fds->upper;
+
+    if (f) {
+        xSemaphoreTake(overlay_sem, portMAX_DELAY);
+        if (!--f->refs && f->whiteout)
+            overlay_truncate(f);
+        xSemaphoreGive(overlay_sem);
+    }
+    fio_priv_free(opaque);
+
+    return 0;
+}
+
+static int overlay_ioctl(void * opaque, int request, void * arg) {
+    struct overlay_fds_t * fds = (struct overlay_fds_t *) opaque;
+    uint32_t size = overlay_size(fds);
+
+    switch (request) {
+    case FIO_NONBLOCK:
+    case FIO_TIMEOUT:
+    case FIO_FLUSH:
+        /* Both layers are plain memory; nothing ever blocks. */
+        return 0;
+    case FIO_NREAD:
+        *(int *) arg = (fds->cursor < size) ? size - fds->cursor : 0;
+        return 0;
+    }
+
+    errno = EINVAL;
+    return -1;
+}
+
+/* Resolve path for fs_open: fills fds with either an upper entry (copied
+ * up from the lower layer when opened for writing) or a lower file.  Must
+ * hold overlay_sem.
+ */
+static int overlay_lookup(struct overlay_t * o, const char * path, int flags, int mode, struct overlay_fds_t * fds) {
+    uint32_t h = romfs_hash(o->lower, path);
+    struct overlay_file_t * f = overlay_find(o, h);
+    file_attr_t attr;
+
+    if (f && f->whiteout) {
+        if (!(flags & O_CREAT)) {
+            errno = ENOENT;
+            return -1;
+        }
+        if (f->refs) {
+            /* Descriptors still open on the unlinked file keep its
+             * contents; the new file gets an entry of its own, ahead of
+             * the whiteout in the list.
+             */
+            f = overlay_create(o, h, path, overlay_new_mode(mode));
+            if (!f)
+                return -1;
+        } else {
+            f->whiteout = 0;
+            f->mode = overlay_new_mode(mode);
+            overlay_truncate(f);
+        }
+    } else if (f) {
+        if (!overlay_access(f->mode, flags)) {
+            errno = EPERM;
+            return -1;
+        }
+        if ((flags & O_TRUNC) && (flags & (O_WRONLY | O_RDWR)))
+            overlay_truncate(f);
+    } else if (!(flags & (O_WRONLY | O_RDWR))) {
+        fds->lower = romfs_get_file_by_hash(o->lower, h);
+        return fds->lower ? 0 : -1;
+    } else if (romfs_get_attr_by_hash(o->lower, h, &attr)) {
+        if (!overlay_access(attr.mode, flags)) {
+            errno = EPERM;
+            return -1;
+        }
+        f = overlay_create(o, h, path, attr.mode);
+        if (!f)
+            return -1;
+        if (!(flags & O_TRUNC)) {
+            if (overlay_reserve(f, attr.size) < 0) {
+                /* Drop the half-made copy so the lower file stays visible. */
+                o->upper = f->next;
+                free(f);
+                return -1;
+            }
+            memcpy(f->data, attr.content, attr.size);
+            f->size = attr.size;
+        }
+    } else if (flags & O_CREAT) {
+        f = overlay_create(o, h, path, overlay_new_mode(mode));
+        if (!f)
+            return -1;
+    } else {
+        errno = ENOENT;
+        return -1;
+    }
+
+    f->refs++;
+    fds->upper = f;
+    return 0;
+}
+
+static int overlay_open(void * opaque, const char * path, int flags, int mode) {
+    struct overlay_t * o = (struct overlay_t *) opaque;
+    struct overlay_fds_t * fds = fio_priv_alloc(sizeof(struct overlay_fds_t));
+    int writing = flags & (O_WRONLY | O_RDWR);
+    int r;
+
+    if (!fds)
+        return -1;
+
+    memset(fds, 0, sizeof(struct overlay_fds_t));
+    fds->flags = flags;
+
+    xSemaphoreTake(overlay_sem, portMAX_DELAY);
+    r = overlay_lookup(o, path, flags, mode, fds);
+    xSemaphoreGive(overlay_sem);
+
+    if (r < 0) {
+        fio_priv_free(fds);
+        return -1;
+    }
+
+    r = fio_open((flags & O_WRONLY) ? NULL : overlay_read,
+                 writing ? overlay_write : NULL,
+                 overlay_seek, overlay_close, fds);
+    if (r >= 0) {
+        fio_set_ioctl(r, overlay_ioctl);
+        fio_set_pio(r, (flags & O_WRONLY) ? NULL : overlay_pread,
+                    writing ? overlay_pwrite : NULL);
+    } else {
+        overlay_close(fds);
+    }
+
+    return r;
+}
+
+static int overlay_unlink(void * opaque, const char * path) {
+    struct overlay_t * o = (struct overlay_t *) opaque;
+    uint32_t h = romfs_hash(o->lower, path);
+    struct overlay_file_t * f;
+    file_attr_t attr;
+    int r = 0;
+
+    xSemaphoreTake(overlay_sem, portMAX_DELAY);
+    f = overlay_find(o, h);
+    if (f && !f->whiteout) {
+        f->whiteout = 1;
+        if (!f->refs)
+            overlay_truncate(f);
+    } else if (!f && romfs_get_attr_by_hash(o->lower, h, &attr)) {
+        f = overlay_create(o, h, path, 0);
+        if (f)
+            f->whiteout = 1;
+        else
+            r = -1;
+    } else {
+        errno = ENOENT;
+        r = -1;
+    }
+    xSemaphoreGive(overlay_sem);
+
+    return r;
+}
+
+/* Step the listing iterator to the next visible file: upper entries
+ * first, then lower files not shadowed or whited out.  Must hold
+ * overlay_sem.
+ */
+static void overlay_iter_advance(struct overlay_iter_t * it) {
+    it->valid = 0;
+
+    while (it->upper) {
+        struct overlay_file_t * f = it->upper;
+
+        it->upper = f->next;
+        if (!f->whiteout) {
+            it->next.hash = f->hash;
+            it->next.name = f->name;
+            it->next.mode = f->mode;
+            it->next.size = f->size;
+            it->next.content = f->data;
+            it->valid = 1;
+            return;
+        }
+    }
+
+    while (it->lower) {
+        it->lower = romfs_mount((void *) it->lower, &it->next);
+        if (!overlay_find(it->ovl, it->next.hash)) {
+            it->valid = 1;
+            return;
+        }
+    }
+}
+
+static void * overlay_mount(void * mountpoint, file_attr_t * attr) {
+    struct overlay_iter_t * it = &overlay_iter;
+
+    if (!mountpoint || !attr)
+        return NULL;
+
+    xSemaphoreTake(overlay_sem, portMAX_DELAY);
+    if (mountpoint != it) {
+        it->ovl = (struct overlay_t *) mountpoint;
+        it->upper = it->ovl->upper;
+        it->lower = it->ovl->lower;
+        overlay_iter_advance(it);
+    }
+    if (it->valid) {
+        memcpy(attr, &it->next, sizeof(file_attr_t));
+        overlay_iter_advance(it);
+    } else {
+        memset(attr, 0, sizeof(file_attr_t));
+        attr->name = "";
+    }
+    xSemaphoreGive(overlay_sem);
+
+    return it->valid ? it : NULL;
+}
+
+void register_overlayfs(const char * mountpoint, uint32_t hash, const uint8_t * romfs) {
+    struct overlay_t * o;
+    DBGOUT("Registering overlayfs `%s' @ %p\r\n", mountpoint, romfs);
+
+    if (!overlay_sem)
+        overlay_sem = xSemaphoreCreateMutex();
+
+    o = malloc(sizeof(struct overlay_t));
+    if (!o)
+        return;
+
+    memset(o, 0, sizeof(struct overlay_t));
+    o->lower = romfs;
+    register_fs(mountpoint, hash, overlay_mount, overlay_open, overlay_unlink, o);
+}
@@ -0,0 +1,17 @@
+#ifndef __OVERLAYFS_H__
+#define __OVERLAYFS_H__
+
+#include <stdint.h>
+
+/* Number of upper-layer misses remembered per overlay mount. */
+#define OVERLAY_NEG_CACHE 32
+
+/* Upper-layer files grow by doubling up to this many bytes at a time and
+ * by this much after that, so a large file does not ask the heap for up
+ * to twice its size.
+ */
+#define OVERLAY_GROW_MAX 1024
+
+void register_overlayfs(const char * mountpoint, uint32_t hash, const uint8_t * romfs);
+
+#endif
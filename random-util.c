@@ -1,31 +1,101 @@
 #include <stdlib.h>
+#include "random-util.h"
+#include "word-util.h"
 
-// PRNG state is the linear feedback shift register (lfsr)
-static unsigned int state = 0xACE1;
+// Used in place of a zero state, which xorshift never leaves
+#define RAND_DEFAULT_SEED 0xACE1u
+// Odd multiplier scrambling the output, from the golden ratio
+#define RAND_MUL 0x9E3779BBu
+
+// State shared by rand() and srand()
+static volatile unsigned int state = RAND_DEFAULT_SEED;
+// Entropy pool fed by rand_stir()
+static volatile uint32_t pool = RAND_DEFAULT_SEED;
+
+// One step of xorshift32, shifts 13, 17, 5
+static uint32_t rand_step(uint32_t x)
+{
+    if (!x)
+        x = RAND_DEFAULT_SEED;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+// Step the shared state; tasks racing for it retry rather than both
+// taking the same number.
+static uint32_t rand_next()
+{
+    unsigned int old, x;
+
+    do {
+        old = state;
+        x = rand_step(old);
+    } while (!__sync_bool_compare_and_swap(&state, old, x));
+
+    return x * RAND_MUL;
+}
 
-// Get a pseudorandom number generator from Wikipedia
-int rand() __attribute__((naked));
 int rand()
 {
-    /* taps: 16 14 13 11; characteristic polynomial: x^16 + x^14 + x^13 + x^11 + 1 */
-    __asm__ (
-        "mov r0, %1\t\n" // r0 = state
-        "eor r1, r0, r0, lsr #2 \t\n" // r1 = (g_state >> 0) ^ (g_state >> 2)
-        "eor r1, r1, r0, lsr #3 \t\n" // r1 = r1 ^ (g_state >> 3)
-        "eor r1, r1, r0, lsr #5 \t\n" // r1 = r1 ^ (g_state >> 5)
-        "and r1, r1, #1         \t\n" // bit = r1 = r1 & 1
-        "lsl r1, r1, #15        \t\n" // r1 = bit << 15
-        "orr r0, r1, r0, lsr #1 \t\n" // state = r1 | (state >> 1)
-        "mov %0, r0             \t\n" // output
-        : "=r" (state)
-        : "r" (state)
-        : "r0", "r1"
-    );
-    __asm__ ("bx lr \t\n");
+    return rand_next() >> 1;
 }
 
 // Set the state of pseudorandom number generator
 void srand(unsigned int seed)
 {
-    state = seed & 0xFFFF;
+    state = seed;
+}
+
+int rand_r(unsigned int *seed)
+{
+    *seed = rand_step(*seed);
+    return (*seed * RAND_MUL) >> 1;
+}
+
+void rand_fill_r(unsigned int *seed, void *buf, size_t len)
+{
+    unsigned char *p = buf;
+    uint32_t x = *seed;
+    uint32_t w;
+
+    for (; len >= 4; len -= 4, p += 4) {
+        x = rand_step(x);
+        STORE32(p, x * RAND_MUL);
+    }
+    if (len) {
+        // Least significant byte first, as STORE32 lays the word out
+        x = rand_step(x);
+        for (w = x * RAND_MUL; len; len--, w >>= 8)
+            *p++ = w;
+    }
+    *seed = x;
+}
+
+// A fill takes one number from the shared state and goes on from there
+// on its own.
+void rand_fill(void *buf, size_t len)
+{
+    unsigned int seed = rand_next();
+
+    rand_fill_r(&seed, buf, len);
+}
+
+// Racing writers may lose a sample, which costs nothing but the sample.
+void rand_stir(uint32_t sample)
+{
+    uint32_t x = pool;
+
+    pool = ((x << 7) | (x >> 25)) ^ (sample * RAND_MUL);
+}
+
+unsigned int rand_entropy()
+{
+    return rand_step(pool);
+}
+
+void srand_entropy()
+{
+    srand(rand_entropy() ^ rand_next());
 }
@@ -0,0 +1,37 @@
+#ifndef __RANDOM_UTIL_H__
+#define __RANDOM_UTIL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Pseudorandom numbers beyond rand() and srand().  The generator is
+ * xorshift32 with its output scrambled by a multiplication, period
+ * 2^32 - 1.  rand() keeps one state for every task and steps it
+ * atomically; the _r functions work on a state the caller keeps, which
+ * may start at any value.
+ */
+
+int rand_r(unsigned int *seed);
+
+/* Fill buf with random bytes, a word at a time.  The bytes come out the
+ * same whatever the alignment of buf, so a fill can be checked by filling
+ * again from the same state.
+ */
+void rand_fill_r(unsigned int *seed, void *buf, size_t len);
+void rand_fill(void *buf, size_t len);
+
+/* Set to 0 to keep hardware timings out of the generator. */
+#ifndef RANDOM_HW_NOISE
+#define RANDOM_HW_NOISE 1
+#endif
+
+/* Mix a noisy sample, such as a free-running counter read when a byte
+ * arrives, into the entropy pool.  Cheap enough for interrupt handlers.
+ */
+void rand_stir(uint32_t sample);
+/* The pool, to seed rand_r() states from. */
+unsigned int rand_entropy();
+/* Reseed rand() from the pool. */
+void srand_entropy();
+
+#endif
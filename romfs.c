@@ -10,32 +10,59 @@
 #include "romfs.h"
 #include "osdebug.h"
 #include "hash-djb2.h"
+#include "hash-murmur3.h"
 
 struct romfs_fds_t {
     const uint8_t * file;
     uint32_t cursor;
 };
 
-static struct romfs_fds_t romfs_fds[MAX_FDS];
-
 static uint32_t get_unaligned(const uint8_t * d) {
     return ((uint32_t) d[0]) | ((uint32_t) (d[1] << 8)) | ((uint32_t) (d[2] << 16)) | ((uint32_t) (d[3] << 24));
 }
 
-static ssize_t romfs_read(void * opaque, void * buf, size_t count) {
+uint32_t romfs_hash(const uint8_t * romfs, const char * path) {
+    int hash = ROMFS_HASH_DJB2;
+
+    if (get_unaligned(romfs) == ROMFS_MAGIC && !romfs[4])
+        hash = get_unaligned(romfs + 5);
+
+    switch (hash) {
+    case ROMFS_HASH_MURMUR3:
+        return hash_murmur3((const uint8_t *) path, -1);
+    }
+    return hash_djb2((const uint8_t *) path, -1);
+}
+
+static ssize_t romfs_pread(void * opaque, void * buf, size_t count, off_t offset) {
     struct romfs_fds_t * f = (struct romfs_fds_t *) opaque;
     const uint8_t * size_p = f->file - 4;
     uint32_t size = get_unaligned(size_p);
 
-    if ((f->cursor + count) > size)
-        count = size - f->cursor;
+    if (offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (offset >= size)
+        return 0;
+    if ((offset + count) > size)
+        count = size - offset;
 
-    memcpy(buf, f->file + f->cursor, count);
-    f->cursor += count;
+    memcpy(buf, f->file + offset, count);
 
     return count;
 }
 
+static ssize_t romfs_read(void * opaque, void * buf, size_t count) {
+    struct romfs_fds_t * f = (struct romfs_fds_t *) opaque;
+    ssize_t r = romfs_pread(opaque, buf, count, f->cursor);
+
+    if (r > 0)
+        f->cursor += r;
+
+    return r;
+}
+
 static off_t romfs_seek(void * opaque, off_t offset, int whence) {
     struct romfs_fds_t * f = (struct romfs_fds_t *) opaque;
     const uint8_t * size_p = f->file - 4;
@@ -68,31 +95,67 @@ static off_t romfs_seek(void * opaque, off_t offset, int whence) {
     return offset;
 }
 
+static int romfs_close(void * opaque) {
+    fio_priv_free(opaque);
+    return 0;
+}
+
+static int romfs_ioctl(void * opaque, int request, void * arg) {
+    struct romfs_fds_t * f = (struct romfs_fds_t *) opaque;
+    uint32_t size = get_unaligned(f->file - 4);
+
+    switch (request) {
+    case FIO_NONBLOCK:
+    case FIO_TIMEOUT:
+    case FIO_FLUSH:
+        /* Reads never block on a memory-mapped image. */
+        return 0;
+    case FIO_NREAD:
+        *(int *) arg = size - f->cursor;
+        return 0;
+    }
+
+    errno = EINVAL;
+    return -1;
+}
+
 static int romfs_open(void * opaque, const char * path, int flags, int mode) {
-    uint32_t h = hash_djb2((const uint8_t *) path, -1);
     const uint8_t * romfs = (const uint8_t *) opaque;
+    uint32_t h = romfs_hash(romfs, path);
     const uint8_t * file;
     int r = -1;
 
     file = romfs_get_file_by_hash(romfs, h);
 
     if (file) {
-        r = fio_open(romfs_read, NULL, romfs_seek, NULL, NULL);
-        if (r > 0) {
-            romfs_fds[r].file = file;
-            romfs_fds[r].cursor = 0;
-            fio_set_opaque(r, romfs_fds + r);
+        struct romfs_fds_t * f = fio_priv_alloc(sizeof(struct romfs_fds_t));
+
+        if (!f)
+            return -1;
+
+        f->file = file;
+        f->cursor = 0;
+        r = fio_open(romfs_read, NULL, romfs_seek, romfs_close, f);
+        if (r >= 0) {
+            fio_set_ioctl(r, romfs_ioctl);
+            fio_set_pio(r, romfs_pread, NULL);
+        } else {
+            fio_priv_free(f);
         }
     }
     return r;
 }
 
-static void * romfs_mount(void * mountpoint, file_attr_t * attr) {
+void * romfs_mount(void * mountpoint, file_attr_t * attr) {
     uint8_t * p = (uint8_t *)mountpoint;
 
     if (!mountpoint || !attr)
         return NULL;
 
+    /* Step over the header to the first entry. */
+    if (get_unaligned(p) == ROMFS_MAGIC && !p[4])
+        p += 13 + get_unaligned(p + 9);
+
     attr->hash = get_unaligned(p);
     p += sizeof(attr->hash);
     attr->name = (const char *)p;
@@ -107,21 +170,29 @@ static void * romfs_mount(void * mountpoint, file_attr_t * attr) {
     return get_unaligned(p) ? p : NULL;
 }
 
-const uint8_t * romfs_get_file_by_hash(const uint8_t * romfs, uint32_t h) {
+int romfs_get_attr_by_hash(const uint8_t * romfs, uint32_t h, file_attr_t * attr) {
     const uint8_t * meta = romfs;
-    file_attr_t attr;
 
     while (meta) {
-        meta = (const uint8_t *)romfs_mount((void *)meta, &attr);
-        if (attr.hash == h) {
-            mode_t r = strcmp(getenv("USER"), "root") ? S_IROTH : S_IRUSR;
-
-	    if (attr.mode & r)
-                return attr.content;
-            else {
-                errno = EPERM;
-                return NULL;
-            }
+        meta = (const uint8_t *)romfs_mount((void *)meta, attr);
+        if (attr->hash == h)
+            return 1;
+    }
+
+    return 0;
+}
+
+const uint8_t * romfs_get_file_by_hash(const uint8_t * romfs, uint32_t h) {
+    file_attr_t attr;
+
+    if (romfs_get_attr_by_hash(romfs, h, &attr)) {
+        mode_t r = strcmp(getenv("USER"), "root") ? S_IROTH : S_IRUSR;
+
+        if (attr.mode & r)
+            return attr.content;
+        else {
+            errno = EPERM;
+            return NULL;
         }
     }
 
@@ -129,7 +200,7 @@ const uint8_t * romfs_get_file_by_hash(const uint8_t * romfs, uint32_t h) {
     return NULL;
 }
 
-void register_romfs(const char * mountpoint, const uint8_t * romfs) {
-//    DBGOUT("Registering romfs `%s' @ %p\r\n", mountpoint, romfs);
-    register_fs(mountpoint, romfs_mount, romfs_open, (void *) romfs);
+void register_romfs(const char * mountpoint, uint32_t hash, const uint8_t * romfs) {
+    DBGOUT("Registering romfs `%s' @ %p\r\n", mountpoint, romfs);
+    register_fs(mountpoint, hash, romfs_mount, romfs_open, NULL, (void *) romfs);
 }
@@ -2,8 +2,23 @@
 #define __ROMFS_H__
 
 #include <stdint.h>
+#include "fattr.h"
 
-void register_romfs(const char * mountpoint, const uint8_t * romfs);
+/* An image may start with a header, laid out as an entry with an empty
+ * name so that romfs_mount() can pass over it: hash ROMFS_MAGIC, mode the
+ * ROMFS_HASH_* its paths are hashed with and size 0.  Images without one
+ * are hashed with djb2.
+ */
+#define ROMFS_MAGIC 0x31534652 /* "RFS1" */
+#define ROMFS_HASH_DJB2 0
+#define ROMFS_HASH_MURMUR3 1
+
+/* Hash path the way the image at romfs is keyed. */
+uint32_t romfs_hash(const uint8_t * romfs, const char * path);
+
+void register_romfs(const char * mountpoint, uint32_t hash, const uint8_t * romfs);
+void * romfs_mount(void * mountpoint, file_attr_t * attr);
+int romfs_get_attr_by_hash(const uint8_t * romfs, uint32_t h, file_attr_t * attr);
 const uint8_t * romfs_get_file_by_hash(const uint8_t * romfs, uint32_t h);
 
 #endif
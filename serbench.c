@@ -0,0 +1,313 @@
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <termios.h>
+#include <unistd.h>
+
+/* Host driver for the shell's "bench" command, typically run against the
+ * pty QEMU prints for -serial pty.  Runs the echo, rx and tx tests and
+ * prints the results, host and target side, as one JSON object.  With -l
+ * it runs "bench libc" instead and passes on the target's cycle counts,
+ * with the throughput each comes to at the target's clock.
+ */
+
+static int fd;
+static int timeout_ms = 5000;
+
+static void usage(const char * binname) {
+    fprintf(stderr, "Usage: %s [-t timeout_ms] [-e echoes] [-n bytes] <tty>\n"
+                    "       %s [-t timeout_ms] -l <tty>\n", binname, binname);
+    exit(-1);
+}
+
+static double now() {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void fail(const char * what) {
+    fprintf(stderr, "serbench: %s\n", what);
+    exit(1);
+}
+
+static void send_buf(const void * buf, int len) {
+    const char * p = buf;
+    int n;
+
+    while (len > 0) {
+        n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            fail("write failed");
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+/* Read one byte, failing after timeout_ms of silence. */
+static int recv_byte() {
+    struct pollfd pfd;
+    unsigned char c;
+    int n;
+
+    for (;;) {
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        n = poll(&pfd, 1, timeout_ms);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            fail("target timed out");
+        n = read(fd, &c, 1);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+        if (n <= 0)
+            fail("read failed");
+        return c;
+    }
+}
+
+/* Skip input up to and including str.  Returns the bytes skipped before it. */
+static long wait_for(const char * str) {
+    int len = strlen(str);
+    int matched = 0;
+    long skipped = 0;
+    int c;
+
+    while (matched < len) {
+        c = recv_byte();
+        if (c == str[matched]) {
+            matched++;
+        } else {
+            skipped += matched + 1;
+            matched = c == str[0];
+            skipped -= matched;
+        }
+    }
+    return skipped;
+}
+
+/* Read the target's result line, which starts at the current '{'. */
+static void recv_result(char * buf, int len) {
+    int i = 0;
+    int c;
+
+    buf[i++] = '{';
+    while ((c = recv_byte()) != '}')
+        if (i < len - 2)
+            buf[i++] = c;
+    buf[i++] = '}';
+    buf[i] = '\0';
+}
+
+/* Read up to the end of the line, leaving out the carriage return. */
+static void recv_line(char * buf, int len) {
+    int i = 0;
+    int c;
+
+    while ((c = recv_byte()) != '\n')
+        if (c != '\r' && i < len - 1)
+            buf[i++] = c;
+    buf[i] = '\0';
+}
+
+static unsigned result_field(const char * result, const char * name) {
+    char key[32];
+    const char * p;
+
+    snprintf(key, sizeof(key), "\"%s\":", name);
+    p = strstr(result, key);
+    return p ? strtoul(p + strlen(key), NULL, 10) : 0;
+}
+
+/* Start "bench <test> <bytes>" and wait until the target is ready. */
+static void start(const char * test, int bytes) {
+    char cmd[32];
+
+    snprintf(cmd, sizeof(cmd), "bench %s %d\r", test, bytes);
+    send_buf(cmd, strlen(cmd));
+    wait_for("READY\r\n");
+}
+
+static void finish(char * result, int len) {
+    wait_for("{");
+    recv_result(result, len);
+    wait_for("# ");
+}
+
+static int cmp_double(const void * a, const void * b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void run_echo(int count) {
+    double * rtt = malloc(count * sizeof(double));
+    double sum = 0;
+    char result[256];
+    unsigned char c;
+    double t;
+    int i;
+
+    start("echo", count);
+    for (i = 0; i < count; i++) {
+        c = 'a' + i % 26;
+        t = now();
+        send_buf(&c, 1);
+        while (recv_byte() != c);
+        rtt[i] = (now() - t) * 1e6;
+        sum += rtt[i];
+    }
+    finish(result, sizeof(result));
+
+    qsort(rtt, count, sizeof(double), cmp_double);
+    printf("  \"echo\": {\"count\": %d, \"min_us\": %.1f, \"avg_us\": %.1f, "
+           "\"p50_us\": %.1f, \"p99_us\": %.1f, \"max_us\": %.1f, "
+           "\"irqs_per_byte\": %.3f, \"target\": %s},\n",
+           count, rtt[0], sum / count, rtt[count / 2], rtt[count * 99 / 100],
+           rtt[count - 1], (double) result_field(result, "irqs") / count, result);
+    free(rtt);
+}
+
+static void run_rx(int bytes) {
+    char buf[256];
+    char result[256];
+    double t;
+    int i, n;
+
+    memset(buf, 'R', sizeof(buf));
+    start("rx", bytes);
+    t = now();
+    for (i = 0; i < bytes; i += n) {
+        n = bytes - i < (int) sizeof(buf) ? bytes - i : (int) sizeof(buf);
+        send_buf(buf, n);
+    }
+    wait_for("{");
+    t = now() - t;
+    recv_result(result, sizeof(result));
+    wait_for("# ");
+
+    printf("  \"rx\": {\"bytes\": %d, \"seconds\": %.3f, \"bytes_per_s\": %.0f, "
+           "\"irqs_per_byte\": %.3f, \"target\": %s},\n",
+           bytes, t, bytes / t, (double) result_field(result, "irqs") / bytes, result);
+}
+
+static void run_tx(int bytes) {
+    char result[256];
+    long got;
+    double t;
+
+    start("tx", bytes);
+    t = now();
+    /* The result line follows a newline the target adds after the data. */
+    got = wait_for("{") - 2;
+    t = now() - t;
+    recv_result(result, sizeof(result));
+    wait_for("# ");
+
+    printf("  \"tx\": {\"bytes\": %ld, \"seconds\": %.3f, \"bytes_per_s\": %.0f, "
+           "\"irqs_per_byte\": %.3f, \"target\": %s}\n",
+           got, t, got / t, (double) result_field(result, "irqs") / bytes, result);
+}
+
+static void run_libc() {
+    char line[256];
+    unsigned hz, len, cycles;
+    char * p;
+    int first = 1;
+
+    send_buf("bench libc\r", 11);
+    wait_for("READY\r\n");
+    wait_for("{");
+    recv_line(line, sizeof(line));
+    hz = result_field(line, "hz");
+    printf("{\n  \"hz\": %u,\n  \"cases\": [\n", hz);
+
+    for (;;) {
+        recv_line(line, sizeof(line));
+        if (!strncmp(line, "]}", 2))
+            break;
+        p = line + (line[0] == ',');
+        len = result_field(p, "len");
+        cycles = result_field(p, "cycles");
+        /* Drop the closing brace to add a field. */
+        p[strlen(p) - 1] = '\0';
+        printf("%s    %s,\"mb_per_s\":%.1f}", first ? "" : ",\n", p,
+               cycles ? (double) len * hz / cycles / 1e6 : 0.0);
+        first = 0;
+    }
+    printf("\n  ]\n}\n");
+    wait_for("# ");
+}
+
+int main(int argc, char ** argv) {
+    const char * binname = argv[0];
+    struct termios tio;
+    int echoes = 1000;
+    int bytes = 16384;
+    int libc = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "t:e:n:l")) != -1) {
+        switch (c) {
+        case 't':
+            timeout_ms = atoi(optarg);
+            break;
+        case 'e':
+            echoes = atoi(optarg);
+            break;
+        case 'n':
+            bytes = atoi(optarg);
+            break;
+        case 'l':
+            libc = 1;
+            break;
+        default:
+            usage(binname);
+        }
+    }
+    if (optind != argc - 1 || echoes < 1 || bytes < 1)
+        usage(binname);
+
+    fd = open(argv[optind], O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        perror(argv[optind]);
+        return 1;
+    }
+    /* A pty may refuse termios calls from this side; that is fine. */
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+
+    /* Get a fresh prompt, whatever state the shell was left in. */
+    send_buf("\r", 1);
+    wait_for("# ");
+    usleep(100000);
+    tcflush(fd, TCIFLUSH);
+
+    if (libc) {
+        run_libc();
+        close(fd);
+        return 0;
+    }
+
+    printf("{\n");
+    run_echo(echoes);
+    run_rx(bytes);
+    run_tx(bytes);
+    printf("}\n");
+
+    close(fd);
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include "serial_io.h"
+#include "random-util.h"
 #include "stm32f10x.h"
 #include "stm32_p103.h"
 
@@ -6,100 +7,753 @@
 #include "semphr.h"
 #include "task.h"
 
-static volatile xSemaphoreHandle serial_tx_wait_sem = NULL;
-static volatile xQueueHandle serial_rx_queue = NULL;
+#include <string.h>
 
-/* Queue structure used for passing characters. */
-typedef struct {
-	char ch;
-} serial_ch_msg;
+#define XON 0x11
+#define XOFF 0x13
 
-/* IRQ handler to handle USART2 interruptss (both transmit and receive
- * interrupts).
+/* State of one USART.  Ports are allocated from the heap the first time
+ * they are opened, so unused ones cost a pointer each.
  */
-void USART2_IRQHandler()
+struct serial_port_t {
+	int port;
+	volatile int flow;
+	volatile int mode;
+
+	/* Transmit ring, drained by DMA.  Writers append at the head; the
+	 * DMA transfer in flight covers tx_dma_len bytes from the tail.
+	 */
+	volatile uint16_t tx_head;
+	volatile uint16_t tx_tail;
+	volatile uint16_t tx_dma_len;
+	xSemaphoreHandle tx_space_sem;
+	xSemaphoreHandle tx_lock;
+
+	/* XON/XOFF to send ahead of the ring, and the byte the DMA sends it
+	 * from.
+	 */
+	volatile uint8_t tx_xchar;
+	uint8_t tx_xbuf;
+	volatile int tx_xbusy;
+	/* Set while the peer has sent XOFF. */
+	volatile int tx_stopped;
+
+	/* Receive ring, filled by DMA in circular mode.  The write position
+	 * is implied by the DMA transfer counter; only the read position is
+	 * kept in software.
+	 */
+	volatile uint16_t rx_tail;
+	/* DMA position seen by the previous receive interrupt. */
+	uint16_t rx_last;
+	/* Bytes accounted by the interrupts but not read yet.  The reader may
+	 * run ahead of the interrupts, so this can briefly go negative.
+	 */
+	volatile int rx_fill;
+	volatile int rx_throttled;
+	xSemaphoreHandle rx_sem;
+
+	volatile struct serial_stats_t stats;
+
+	/* Canonical input: the line being edited, then the finished line
+	 * until the reader has taken all of it.  Only the reader touches it.
+	 */
+	char line[SERIAL_LINE_SIZE];
+	int line_len;
+	int line_pos;
+	int line_done;
+	/* The last byte cooked was a CR that ended a line, so an LF right
+	 * after it belongs to the same line end.
+	 */
+	int line_cr;
+
+	uint8_t rx_ring[SERIAL_RX_RING_SIZE];
+	uint8_t tx_ring[SERIAL_TX_RING_SIZE];
+};
+
+static struct serial_port_t *serial_ports[SERIAL_PORTS];
+static xSemaphoreHandle serial_open_lock = NULL;
+
+static struct serial_port_t *serial_port(int port)
 {
-	static signed portBASE_TYPE xHigherPriorityTaskWoken;
+	if (port < 0 || port >= SERIAL_PORTS)
+		return NULL;
+	return serial_ports[port];
+}
 
-	/* If this interrupt is for a transmit... */
-	if (USART_GetITStatus(USART2, USART_IT_TXE) != RESET) {
-		/* "give" the serial_tx_wait_sem semaphore to notfiy processes
-		 * that the buffer has a spot free for the next byte.
-		 */
-		xSemaphoreGiveFromISR(serial_tx_wait_sem, &xHigherPriorityTaskWoken);
+static uint16_t serial_rx_head(struct serial_port_t *p)
+{
+	return (SERIAL_RX_RING_SIZE - get_rs232_rx_dma_count(p->port)) % SERIAL_RX_RING_SIZE;
+}
+
+static void serial_tx_dma_start(struct serial_port_t *p, const uint8_t *buf, uint16_t len)
+{
+	p->tx_dma_len = len;
+	start_rs232_tx_dma(p->port, buf, len);
+}
+
+/* Start a DMA transfer for a pending XON/XOFF or the next contiguous span
+ * of the transmit ring, unless one is already running.  Called with the
+ * port's DMA interrupts masked.
+ */
+static void serial_tx_kick(struct serial_port_t *p)
+{
+	uint16_t head = p->tx_head;
+	uint16_t tail = p->tx_tail;
+	uint16_t len;
+
+	if (p->tx_dma_len)
+		return;
+
+	if (p->tx_xchar) {
+		p->tx_xbuf = p->tx_xchar;
+		p->tx_xchar = 0;
+		p->tx_xbusy = 1;
+		serial_tx_dma_start(p, &p->tx_xbuf, 1);
+		return;
+	}
+
+	if (p->tx_stopped || head == tail)
+		return;
 
-		/* Disables the transmit interrupt. */
-		USART_ITConfig(USART2, USART_IT_TXE, DISABLE);
+	len = (head > tail ? head : SERIAL_TX_RING_SIZE) - tail;
+	/* Keep spans short so a pending XOFF is not stuck behind them. */
+	if (p->flow == SERIAL_FLOW_XONXOFF && len > SERIAL_TX_XSPAN)
+		len = SERIAL_TX_XSPAN;
+	serial_tx_dma_start(p, p->tx_ring + tail, len);
+}
+
+/* Ask the peer to pause or resume sending.  Called with interrupts masked
+ * or from an ISR.
+ */
+static void serial_rx_throttle(struct serial_port_t *p, int throttle)
+{
+	if (throttle == p->rx_throttled)
+		return;
+
+	p->rx_throttled = throttle;
+	if (p->flow == SERIAL_FLOW_RTSCTS) {
+		set_rs232_rts(p->port, !throttle);
+	}
+	else if (p->flow == SERIAL_FLOW_XONXOFF) {
+		p->tx_xchar = throttle ? XOFF : XON;
+		serial_tx_kick(p);
 	}
-	/* If this interrupt is for a receive... */
-	else if (USART_GetITStatus(USART2, USART_IT_RXNE) != RESET) {
-		serial_ch_msg rx_msg;
+}
 
-		/* Receive the byte from the buffer. */
-		rx_msg.ch = USART_ReceiveData(USART2);
+/* Account for the bytes the receive DMA stored since the last interrupt.
+ * Called from the receive ISRs; HT/TC interrupts guarantee the DMA moves
+ * at most half a ring between two calls.
+ */
+static void serial_rx_update(struct serial_port_t *p)
+{
+	uint16_t head = serial_rx_head(p);
+	uint16_t n = (head + SERIAL_RX_RING_SIZE - p->rx_last) % SERIAL_RX_RING_SIZE;
+	uint16_t i;
 
-		/* Queue the received byte. */
-		if (!xQueueSendToBackFromISR(serial_rx_queue, &rx_msg, &xHigherPriorityTaskWoken)) {
-			/* If there was an error queueing the received byte,
-			 * freeze.
-			 */
-			while(1);
+	if (p->flow == SERIAL_FLOW_XONXOFF) {
+		for (i = p->rx_last; i != head; i = (i + 1) % SERIAL_RX_RING_SIZE) {
+			if (p->rx_ring[i] == XOFF) {
+				p->tx_stopped = 1;
+			}
+			else if (p->rx_ring[i] == XON) {
+				p->tx_stopped = 0;
+				serial_tx_kick(p);
+			}
 		}
 	}
-	else {
-		/* Only transmit and receive interrupts should be enabled.
-		 * If this is another type of interrupt, freeze.
+
+	p->rx_last = head;
+	p->stats.rx_bytes += n;
+	p->rx_fill += n;
+
+	if (p->rx_fill >= SERIAL_RX_RING_SIZE) {
+		/* The DMA lapped the reader, so what is left in the ring is
+		 * out of order.  Drop all of it and start over from here.
 		 */
-		while(1);
+		p->stats.rx_dropped += p->rx_fill;
+		p->stats.rx_overflows++;
+		p->rx_fill = 0;
+		p->rx_tail = head;
 	}
+	else if (p->rx_fill >= SERIAL_RX_HIGH_WATER) {
+		serial_rx_throttle(p, 1);
+	}
+}
+
+/* USART interrupt (idle line and receive errors). */
+static void serial_usart_isr(int port)
+{
+	struct serial_port_t *p = serial_ports[port];
+	signed portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+
+	p->stats.irqs++;
+
+#if RANDOM_HW_NOISE
+	/* When input arrives is up to whoever sends it. */
+	rand_stir(SysTick->VAL);
+#endif
+
+	/* A byte arrived before the DMA took the previous one. */
+	if (clear_rs232_interrupts(port))
+		p->stats.rx_overruns++;
+
+	/* Wake the reader for whatever the DMA has stored so far. */
+	serial_rx_update(p);
+	xSemaphoreGiveFromISR(p->rx_sem, &xHigherPriorityTaskWoken);
 
 	if (xHigherPriorityTaskWoken) {
 		taskYIELD();
 	}
 }
 
+/* Transmit DMA interrupt: the span in flight has been handed to the
+ * USART.
+ */
+static void serial_tx_dma_isr(int port)
+{
+	struct serial_port_t *p = serial_ports[port];
+	signed portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+
+	p->stats.irqs++;
+	clear_rs232_tx_dma(port);
+	if (p->tx_xbusy) {
+		p->tx_xbusy = 0;
+	}
+	else {
+		p->tx_tail = (p->tx_tail + p->tx_dma_len) % SERIAL_TX_RING_SIZE;
+		p->stats.tx_bytes += p->tx_dma_len;
+	}
+	p->tx_dma_len = 0;
+	serial_tx_kick(p);
+
+	/* Let a writer waiting for room continue. */
+	xSemaphoreGiveFromISR(p->tx_space_sem, &xHigherPriorityTaskWoken);
+
+	if (xHigherPriorityTaskWoken) {
+		taskYIELD();
+	}
+}
+
+/* Receive DMA interrupt: the ring is half or completely filled. */
+static void serial_rx_dma_isr(int port)
+{
+	struct serial_port_t *p = serial_ports[port];
+	signed portBASE_TYPE xHigherPriorityTaskWoken = pdFALSE;
+
+	p->stats.irqs++;
+	clear_rs232_rx_dma(port);
+	serial_rx_update(p);
+	xSemaphoreGiveFromISR(p->rx_sem, &xHigherPriorityTaskWoken);
+
+	if (xHigherPriorityTaskWoken) {
+		taskYIELD();
+	}
+}
+
+/* IRQ handlers for USART1 and its DMA1 channels 4 (Tx) and 5 (Rx). */
+void USART1_IRQHandler()
+{
+	serial_usart_isr(0);
+}
+
+void DMA1_Channel4_IRQHandler()
+{
+	serial_tx_dma_isr(0);
+}
+
+void DMA1_Channel5_IRQHandler()
+{
+	serial_rx_dma_isr(0);
+}
+
+/* IRQ handlers for USART2 and its DMA1 channels 7 (Tx) and 6 (Rx). */
+void USART2_IRQHandler()
+{
+	serial_usart_isr(1);
+}
+
+void DMA1_Channel7_IRQHandler()
+{
+	serial_tx_dma_isr(1);
+}
+
+void DMA1_Channel6_IRQHandler()
+{
+	serial_rx_dma_isr(1);
+}
+
+/* IRQ handlers for USART3 and its DMA1 channels 2 (Tx) and 3 (Rx). */
+void USART3_IRQHandler()
+{
+	serial_usart_isr(2);
+}
+
+void DMA1_Channel2_IRQHandler()
+{
+	serial_tx_dma_isr(2);
+}
+
+void DMA1_Channel3_IRQHandler()
+{
+	serial_rx_dma_isr(2);
+}
+
 __attribute__((constructor)) void init_serial_io()
 {
-	init_rs232();
-	enable_rs232_interrupts();
-	enable_rs232();
+	if (!serial_open_lock)
+		serial_open_lock = xSemaphoreCreateMutex();
 
-	/* Create the queue used by the serial task.  Messages for write to
-	 * the RS232.
+	/* The console is always up so that stdio works from the start, and
+	 * it edits lines itself so the shell only wakes up once per command.
 	 */
-	vSemaphoreCreateBinary(serial_tx_wait_sem);
+	serial_open(SERIAL_CONSOLE, SERIAL_DEFAULT_BAUD);
+	serial_set_mode(SERIAL_CONSOLE, SERIAL_MODE_CANON);
+}
+
+/* Bring up a port at the given baud rate.  Opening a port that is already
+ * up leaves it as it is.  Returns 0 on success, -1 otherwise.
+ */
+int serial_open(int port, uint32_t baud)
+{
+	struct serial_port_t *p;
+	int ret = 0;
+
+	if (port < 0 || port >= SERIAL_PORTS)
+		return -1;
+
+	while (!xSemaphoreTake(serial_open_lock, portMAX_DELAY));
 
-	/* Create the queue used by the serial task.  Messages for read from
-	 * the RS232.
+	if (serial_ports[port])
+		goto out;
+
+	p = pvPortMalloc(sizeof(struct serial_port_t));
+	if (!p) {
+		ret = -1;
+		goto out;
+	}
+	memset(p, 0, sizeof(struct serial_port_t));
+	p->port = port;
+	p->flow = SERIAL_FLOW_NONE;
+	p->mode = SERIAL_MODE_RAW;
+
+	/* Create the semaphore the transmit DMA interrupt gives whenever
+	 * room is freed in the ring, the mutex that keeps writers from
+	 * interleaving their spans, and the semaphore the receive interrupts
+	 * give whenever new bytes have landed in the ring.  The semaphores
+	 * start empty.
 	 */
-	serial_rx_queue = xQueueCreate(1, sizeof(serial_ch_msg));
+	vSemaphoreCreateBinary(p->tx_space_sem);
+	p->tx_lock = xSemaphoreCreateMutex();
+	vSemaphoreCreateBinary(p->rx_sem);
+	if (!p->tx_space_sem || !p->tx_lock || !p->rx_sem) {
+		if (p->tx_space_sem)
+			vSemaphoreDelete(p->tx_space_sem);
+		if (p->tx_lock)
+			vSemaphoreDelete(p->tx_lock);
+		if (p->rx_sem)
+			vSemaphoreDelete(p->rx_sem);
+		vPortFree(p);
+		ret = -1;
+		goto out;
+	}
+	xSemaphoreTake(p->tx_space_sem, 0);
+	xSemaphoreTake(p->rx_sem, 0);
+
+	/* Publish the port before its interrupts can fire. */
+	serial_ports[port] = p;
+
+	init_rs232(port, baud);
+	enable_rs232_rx_dma(port, p->rx_ring, SERIAL_RX_RING_SIZE);
+	enable_rs232_tx_dma(port);
+	enable_rs232_interrupts(port);
+	enable_rs232(port);
+
+out:
+	xSemaphoreGive(serial_open_lock);
+	return ret;
+}
+
+/* Select SERIAL_FLOW_NONE, SERIAL_FLOW_RTSCTS or SERIAL_FLOW_XONXOFF. */
+void serial_set_flow(int port, int flow)
+{
+	struct serial_port_t *p = serial_port(port);
+
+	if (!p)
+		return;
+
+	taskENTER_CRITICAL();
+	p->flow = flow;
+	p->rx_throttled = 0;
+	p->tx_stopped = 0;
+	if (flow == SERIAL_FLOW_RTSCTS)
+		enable_rs232_flow_control(port);
+	else
+		disable_rs232_flow_control(port);
+	serial_tx_kick(p);
+	taskEXIT_CRITICAL();
+}
+
+int serial_get_mode(int port)
+{
+	struct serial_port_t *p = serial_port(port);
+
+	return p ? p->mode : -1;
+}
+
+/* Select the line discipline: SERIAL_MODE_RAW, SERIAL_MODE_CANON or any
+ * mix of the SERIAL_* flags.  A partly edited line is kept and handed out
+ * as it is if canonical input is turned off.
+ */
+void serial_set_mode(int port, int mode)
+{
+	struct serial_port_t *p = serial_port(port);
+
+	if (p)
+		p->mode = mode;
+}
+
+/* Copy the port's counters into *stats.  Returns -1 if it is not open. */
+int serial_get_stats(int port, struct serial_stats_t *stats)
+{
+	struct serial_port_t *p = serial_port(port);
+
+	if (!p)
+		return -1;
+
+	taskENTER_CRITICAL();
+	memcpy(stats, (const void *) &p->stats, sizeof(*stats));
+	taskEXIT_CRITICAL();
+
+	return 0;
 }
 
 void send_byte(char ch)
 {
-	/* Wait until the RS232 port can receive another byte (this semaphore
-	 * is "given" by the RS232 port interrupt when the buffer has room for
-	 * another byte.
-	 */
-	while (!xSemaphoreTake(serial_tx_wait_sem, portMAX_DELAY));
+	serial_write(SERIAL_CONSOLE, &ch, 1);
+}
 
-	/* Send the byte and enable the transmit interrupt (it is disabled by
-	 * the interrupt).
-	 */
-	USART_SendData(USART2, ch);
-	USART_ITConfig(USART2, USART_IT_TXE, ENABLE);
+/* Copy len bytes into the transmit ring, blocking only while it is full.
+ * Called with tx_lock held.
+ */
+static void serial_tx_put(struct serial_port_t *p, const char *buf, int len)
+{
+	int n = 0;
+
+	while (n < len) {
+		uint16_t head = p->tx_head;
+		uint16_t used = (head + SERIAL_TX_RING_SIZE - p->tx_tail) % SERIAL_TX_RING_SIZE;
+		int span = SERIAL_TX_RING_SIZE - 1 - used;
+
+		if (!span) {
+			xSemaphoreTake(p->tx_space_sem, portMAX_DELAY);
+			continue;
+		}
+		if (span > SERIAL_TX_RING_SIZE - head)
+			span = SERIAL_TX_RING_SIZE - head;
+		if (span > len - n)
+			span = len - n;
+
+		memcpy(p->tx_ring + head, buf + n, span);
+		n += span;
+
+		taskENTER_CRITICAL();
+		p->tx_head = (head + span) % SERIAL_TX_RING_SIZE;
+		serial_tx_kick(p);
+		taskEXIT_CRITICAL();
+	}
 }
 
-char recv_byte(int *log)
+/* Queue len bytes for the port, turning each '\n' into "\r\n" under
+ * SERIAL_ONLCR.  Returns once the last byte is queued, not when it is on
+ * the wire.
+ */
+int serial_write(int port, const char *buf, int len)
 {
-	serial_ch_msg msg = {0};
+	struct serial_port_t *p = serial_port(port);
+	const char *end = buf + len;
+	const char *q;
 
-	/* Non-blocking input. Log keeps pdTRUE or pdFALSE. */
-	if (log)
-		*log = xQueueReceive(serial_rx_queue, &msg, 10);
-	/* Wait for a byte to be queued by the receive interrupts handler. */
-	else
-		while (!xQueueReceive(serial_rx_queue, &msg, portMAX_DELAY));
+	if (!p)
+		return -1;
+
+	while (!xSemaphoreTake(p->tx_lock, portMAX_DELAY));
+
+	if (p->mode & SERIAL_ONLCR) {
+		/* Queue whole runs between newlines. */
+		while (buf < end) {
+			for (q = buf; q < end && *q != '\n'; q++);
+			if (q > buf)
+				serial_tx_put(p, buf, q - buf);
+			if (q == end)
+				break;
+			serial_tx_put(p, "\r\n", 2);
+			buf = q + 1;
+		}
+	}
+	else {
+		serial_tx_put(p, buf, len);
+	}
+
+	xSemaphoreGive(p->tx_lock);
+
+	return len;
+}
+
+/* Queue echoed input as it is, whatever the output flags. */
+static void serial_echo(struct serial_port_t *p, const char *buf, int len)
+{
+	while (!xSemaphoreTake(p->tx_lock, portMAX_DELAY));
+	serial_tx_put(p, buf, len);
+	xSemaphoreGive(p->tx_lock);
+}
+
+char recv_byte()
+{
+	char ch;
+
+	/* Wait for a byte to be stored by the receive DMA. */
+	while (serial_read(SERIAL_CONSOLE, &ch, 1, portMAX_DELAY) != 1);
+
+	return ch;
+}
+
+/* Remove XON/XOFF from buf in place; returns the bytes left. */
+static int serial_strip_xchars(char *buf, int len)
+{
+	int i;
+	int n = 0;
+
+	for (i = 0; i < len; i++) {
+		if (buf[i] != XON && buf[i] != XOFF)
+			buf[n++] = buf[i];
+	}
+
+	return n;
+}
+
+/* Take up to len received bytes from the ring into buf, waiting at most
+ * timeout ticks for the first one.  With eol set, stop after the first CR
+ * or NL.  Returns the number of bytes copied.
+ */
+static int serial_rx_take(struct serial_port_t *p, char *buf, int len, portTickType timeout, int eol)
+{
+	int n = 0;
+
+	while (n == 0) {
+		uint32_t overflows;
+		uint16_t tail;
+		uint16_t head;
+		int used = 0;
+		int found = 0;
+		int i;
+
+		while (serial_rx_head(p) == p->rx_tail) {
+			if (!xSemaphoreTake(p->rx_sem, timeout))
+				return 0;
+		}
+
+		/* An overflow moves the tail; take both from the same moment so
+		 * the check below only fails for one that happens while copying.
+		 */
+		taskENTER_CRITICAL();
+		overflows = p->stats.rx_overflows;
+		tail = p->rx_tail;
+		taskEXIT_CRITICAL();
+		head = serial_rx_head(p);
+		if (head == tail)
+			continue;
 
-	return msg.ch;
+		/* Copy at most two spans: up to the end of the ring, then
+		 * from its start.
+		 */
+		while (used < len && tail != head && !found) {
+			int span = (head > tail ? head : SERIAL_RX_RING_SIZE) - tail;
+
+			if (span > len - used)
+				span = len - used;
+			if (eol) {
+				for (i = 0; i < span; i++) {
+					if (p->rx_ring[tail + i] == '\r' || p->rx_ring[tail + i] == '\n') {
+						span = i + 1;
+						found = 1;
+						break;
+					}
+				}
+			}
+			memcpy(buf + used, p->rx_ring + tail, span);
+			used += span;
+			tail = (tail + span) % SERIAL_RX_RING_SIZE;
+		}
+
+		n = used;
+		if (p->flow == SERIAL_FLOW_XONXOFF)
+			n = serial_strip_xchars(buf, used);
+
+		taskENTER_CRITICAL();
+		/* If the ring overflowed while copying, the interrupt has
+		 * already moved the tail; keep its position.
+		 */
+		if (overflows == p->stats.rx_overflows) {
+			p->rx_tail = tail;
+			p->rx_fill -= used;
+		}
+		if (p->rx_fill <= SERIAL_RX_LOW_WATER)
+			serial_rx_throttle(p, 0);
+		taskEXIT_CRITICAL();
+	}
+
+	return n;
+}
+
+/* Apply the line discipline to the n raw bytes just stored at the end of
+ * the line being edited.  Erase and CR mapping are done in place, since
+ * the edited line never grows past the raw bytes it is built from.
+ */
+static void serial_cook(struct serial_port_t *p, int n)
+{
+	const char *in = p->line + p->line_len;
+	char echo[32];
+	int e = 0;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		char c = in[i];
+		int cr = p->line_cr;
+
+		if (e > (int) sizeof(echo) - 3) {
+			serial_echo(p, echo, e);
+			e = 0;
+		}
+
+		p->line_cr = c == '\r' && (p->mode & SERIAL_ICRNL);
+		if (c == '\n' && cr)
+			continue;
+		if (p->line_cr)
+			c = '\n';
+
+		if (c == '\n') {
+			p->line[p->line_len++] = c;
+			p->line_done = 1;
+			if (p->mode & SERIAL_ONLCR)
+				echo[e++] = '\r';
+			echo[e++] = '\n';
+		}
+		else if (c == 127 || c == '\b') {
+			if (p->line_len > 0) {
+				p->line_len--;
+				echo[e++] = '\b';
+				echo[e++] = ' ';
+				echo[e++] = '\b';
+			}
+		}
+		else if (p->line_len < SERIAL_LINE_SIZE - 1) {
+			/* The last byte is kept for the newline. */
+			p->line[p->line_len++] = c;
+			echo[e++] = c;
+		}
+	}
+
+	if (e && (p->mode & SERIAL_ECHO))
+		serial_echo(p, echo, e);
+}
+
+/* Hand out what is left of the edited line. */
+static int serial_line_take(struct serial_port_t *p, char *buf, int len)
+{
+	int n = p->line_len - p->line_pos;
+
+	if (n > len)
+		n = len;
+	memcpy(buf, p->line + p->line_pos, n);
+	p->line_pos += n;
+	if (p->line_pos == p->line_len)
+		p->line_len = p->line_pos = p->line_done = 0;
+
+	return n;
+}
+
+/* Copy up to len received bytes into buf, waiting at most timeout ticks
+ * for the first one.  In canonical mode nothing is returned until a whole
+ * line has been entered, and no more than one line at a time.  Returns the
+ * number of bytes copied.
+ */
+int serial_read(int port, char *buf, int len, portTickType timeout)
+{
+	struct serial_port_t *p = serial_port(port);
+	int n;
+
+	if (!p)
+		return -1;
+
+	if (p->mode & SERIAL_ICANON) {
+		while (!p->line_done) {
+			n = serial_rx_take(p, p->line + p->line_len,
+			                   SERIAL_LINE_SIZE - p->line_len, timeout, 1);
+			if (n <= 0)
+				return n;
+			serial_cook(p, n);
+		}
+	}
+
+	if (p->line_pos < p->line_len)
+		return serial_line_take(p, buf, len);
+
+	n = serial_rx_take(p, buf, len, timeout, 0);
+	if (n > 0 && (p->mode & SERIAL_ECHO))
+		serial_echo(p, buf, n);
+
+	return n;
+}
+
+static int serial_rx_pending(struct serial_port_t *p)
+{
+	return (serial_rx_head(p) + SERIAL_RX_RING_SIZE - p->rx_tail) % SERIAL_RX_RING_SIZE;
+}
+
+/* Bytes serial_read() can return without blocking.  In canonical mode
+ * that is only a finished line.
+ */
+int serial_rx_available(int port)
+{
+	struct serial_port_t *p = serial_port(port);
+
+	if (!p)
+		return 0;
+	if (p->mode & SERIAL_ICANON)
+		return p->line_done ? p->line_len - p->line_pos : 0;
+	return p->line_len - p->line_pos + serial_rx_pending(p);
+}
+
+/* Discard any received bytes not yet read. */
+void serial_rx_flush(int port)
+{
+	struct serial_port_t *p = serial_port(port);
+
+	if (!p)
+		return;
+
+	p->line_len = p->line_pos = p->line_done = p->line_cr = 0;
+
+	taskENTER_CRITICAL();
+	p->rx_fill -= serial_rx_pending(p);
+	p->rx_tail = serial_rx_head(p);
+	serial_rx_throttle(p, 0);
+	taskEXIT_CRITICAL();
+	xSemaphoreTake(p->rx_sem, 0);
+}
+
+/* Wait until every queued byte has been handed to the USART. */
+void serial_tx_flush(int port)
+{
+	struct serial_port_t *p = serial_port(port);
+
+	if (!p)
+		return;
+
+	/* Poll rather than take tx_space_sem: that give is what wakes a
+	 * writer waiting for room, and taking it here could leave the writer
+	 * asleep with no transfer left to give it again.
+	 */
+	while (p->tx_dma_len || p->tx_head != p->tx_tail)
+		vTaskDelay(1);
 }
@@ -1,8 +1,66 @@
 #ifndef SERIAL_IO_H
 #define SERIAL_IO_H
 
+#include <stdint.h>
+#include "FreeRTOS.h"
+
+/* Ports handled by the driver, exposed as /dev/ttyS0 onwards. */
+#define SERIAL_PORTS 3
+/* The port carrying stdin, stdout and stderr (USART2). */
+#define SERIAL_CONSOLE 1
+/* Baud rate a port is opened at unless told otherwise. */
+#define SERIAL_DEFAULT_BAUD 9600
+
+/* Size of each port's DMA receive ring; the reader is woken at each half. */
+#define SERIAL_RX_RING_SIZE 128
+/* Size of each port's transmit ring drained by DMA. */
+#define SERIAL_TX_RING_SIZE 256
+
+/* Receive ring fill levels at which the peer is throttled and released. */
+#define SERIAL_RX_HIGH_WATER (SERIAL_RX_RING_SIZE * 3 / 4)
+#define SERIAL_RX_LOW_WATER (SERIAL_RX_RING_SIZE / 4)
+/* Longest DMA transmit span while XON/XOFF is in use. */
+#define SERIAL_TX_XSPAN 16
+
+/* Line discipline flags, combined with serial_set_mode(). */
+#define SERIAL_ICANON 0x01	/* deliver input a line at a time, with erase */
+#define SERIAL_ECHO 0x02	/* echo input back as it is received */
+#define SERIAL_ICRNL 0x04	/* turn CR, or CR NL, into NL on canonical input */
+#define SERIAL_ONLCR 0x08	/* turn NL into CR NL on output */
+#define SERIAL_MODE_RAW 0
+#define SERIAL_MODE_CANON (SERIAL_ICANON | SERIAL_ECHO | SERIAL_ICRNL | SERIAL_ONLCR)
+/* Longest canonical line, newline included. */
+#define SERIAL_LINE_SIZE 64
+
+enum serial_flow_t {
+	SERIAL_FLOW_NONE,
+	SERIAL_FLOW_RTSCTS,
+	SERIAL_FLOW_XONXOFF,
+};
+
+struct serial_stats_t {
+	uint32_t rx_bytes;
+	uint32_t rx_dropped;	/* bytes discarded when the ring overflowed */
+	uint32_t rx_overflows;	/* times the receive DMA lapped the reader */
+	uint32_t rx_overruns;	/* USART overrun errors */
+	uint32_t tx_bytes;
+	uint32_t irqs;
+};
+
 __attribute__((constructor)) void init_serial_io();
+int serial_open(int port, uint32_t baud);
+int serial_write(int port, const char *buf, int len);
+int serial_read(int port, char *buf, int len, portTickType timeout);
+int serial_rx_available(int port);
+void serial_rx_flush(int port);
+void serial_tx_flush(int port);
+void serial_set_flow(int port, int flow);
+int serial_get_mode(int port);
+void serial_set_mode(int port, int mode);
+int serial_get_stats(int port, struct serial_stats_t *stats);
+
+/* Blocking single-byte access to the console port. */
 void send_byte(char ch);
-char recv_byte(int *log);
+char recv_byte();
 
 #endif
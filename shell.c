@@ -11,14 +11,22 @@
 #include "fio.h"
 #include "filesystem.h"
 #include "osdebug.h"
+#include "serial_io.h"
+#include "console.h"
+#include "framedev.h"
+#include "libbench.h"
 #include "shell.h"
+#include "string-util.h"
 
 /* Command handlers. */
+static void cmd_bench(int argc, char *argv[]);
 static void cmd_cat(int argc, char *argv[]);
+static void cmd_dmesg(int argc, char *argv[]);
 static void cmd_echo(int argc, char *argv[]);
 static void cmd_export(int argc, char *argv[]);
 static void cmd_help(int argc, char *argv[]);
 static void cmd_history(int argc, char *argv[]);
+static void cmd_iostat(int argc, char *argv[]);
 static void cmd_ls(int argc, char *argv[]);
 static void cmd_man(int argc, char *argv[]);
 static void cmd_mmtest(int argc, char *argv[]);
@@ -34,11 +42,14 @@ typedef struct {
 #define CMD_DEF(name, desc) \
 	[CMD_ ## name] = {.cmd = #name, .func = cmd_ ## name, .description = desc "."}
 static const hcmd_entry cmd_data[CMD_COUNT] = {
+	CMD_DEF(bench, "Serial & libc benchmarks"),
 	CMD_DEF(cat, "Concatenate & print files"),
+	CMD_DEF(dmesg, "Print the debug log"),
 	CMD_DEF(echo, "Show words you input"),
 	CMD_DEF(export, "Export environment variables"),
 	CMD_DEF(help, "List all commands you can use"),
 	CMD_DEF(history, "Show latest commands entered"),
+	CMD_DEF(iostat, "Show I/O statistics"),
 	CMD_DEF(ls, "List files (& attributes)"),
 	CMD_DEF(man, "Manual pager"),
 	CMD_DEF(mmtest, "Test malloc()"),
@@ -237,11 +248,83 @@ static void execute_command()
 		}
 	}
 	if (i == CMD_COUNT) {
-		puts(argv[0]);
-		fio_write(2, ": command not found\n", 20);
+		dprintf(2, "%s: command not found\n", argv[0]);
 	}
 }
 
+/* Command "bench": one serial benchmark on the console, driven from the
+ * host by serbench.  "bench echo|rx|tx <bytes>" prints READY, then echoes,
+ * swallows or sends that many raw bytes and prints the result as a JSON
+ * line.  "bench libc" prints READY and the cycle counts of libbench.h.
+ */
+static void cmd_bench(int argc, char *argv[])
+{
+	struct serial_stats_t s0, s1;
+	portTickType start, ticks;
+	char buf[64];
+	const char *p;
+	int mode, raw;
+	int n = 0;
+	int i, len;
+
+	if (argc == 2 && !strcmp(argv[1], "libc")) {
+		puts("READY\n");
+		libbench_run();
+		return;
+	}
+
+	if (argc == 3)
+		for (p = argv[2]; *p >= '0' && *p <= '9'; p++)
+			n = n * 10 + *p - '0';
+	if (n <= 0 || (strcmp(argv[1], "echo") && strcmp(argv[1], "rx") &&
+	               strcmp(argv[1], "tx"))) {
+		fio_write(2, "Usage: bench echo|rx|tx <bytes> | libc\n", 39);
+		return;
+	}
+
+	/* Take input raw; only the echo test has the driver echo it. */
+	fio_ioctl(0, FIO_TCGETS, &mode);
+	raw = mode & ~(SERIAL_ICANON | SERIAL_ECHO | SERIAL_ICRNL);
+	if (!strcmp(argv[1], "echo"))
+		raw |= SERIAL_ECHO;
+	fio_ioctl(0, FIO_TCSETS, &raw);
+
+	puts("READY\n");
+	console_flush();
+	serial_tx_flush(SERIAL_CONSOLE);
+	serial_get_stats(SERIAL_CONSOLE, &s0);
+	start = xTaskGetTickCount();
+
+	if (!strcmp(argv[1], "tx")) {
+		memset(buf, 'U', sizeof(buf));
+		for (i = 0; i < n; i += len) {
+			len = n - i < sizeof(buf) ? n - i : sizeof(buf);
+			fio_write(1, buf, len);
+		}
+		console_flush();
+		serial_tx_flush(SERIAL_CONSOLE);
+	}
+	else {
+		for (i = 0; i < n; i += len) {
+			len = fio_read(0, buf, n - i < sizeof(buf) ? n - i : sizeof(buf));
+			if (len <= 0)
+				break;
+		}
+	}
+
+	ticks = xTaskGetTickCount() - start;
+	serial_get_stats(SERIAL_CONSOLE, &s1);
+	fio_ioctl(0, FIO_TCSETS, &mode);
+
+	printf("\n{\"test\":\"%s\",\"bytes\":%d,\"ticks\":%u,\"hz\":%u,"
+	       "\"irqs\":%u,\"rx_bytes\":%u,\"tx_bytes\":%u,"
+	       "\"dropped\":%u,\"overruns\":%u}\n",
+	       argv[1], n, (unsigned) ticks, (unsigned) configTICK_RATE_HZ,
+	       s1.irqs - s0.irqs, s1.rx_bytes - s0.rx_bytes,
+	       s1.tx_bytes - s0.tx_bytes, s1.rx_dropped - s0.rx_dropped,
+	       s1.rx_overruns - s0.rx_overruns);
+}
+
 /* Command "cat" */
 static void cmd_cat(int argc, char *argv[])
 {
@@ -251,8 +334,12 @@ static void cmd_cat(int argc, char *argv[])
 	int i;
 
 	for (i = 1; i < argc; i++) {
-		sprintf(buf, "%s/%s", cwd, argv[i]);
-		fd = fs_open(buf, 0, O_RDONLY);
+		if (snprintf(buf, sizeof(buf), "%s/%s", cwd, argv[i]) >= sizeof(buf)) {
+			errno = ENAMETOOLONG;
+			fd = -1;
+		}
+		else
+			fd = fs_open(buf, 0, O_RDONLY);
 
 		if (fd < 0) {
 			fio_write(2, "cat: ", 5);
@@ -273,6 +360,13 @@ static void cmd_cat(int argc, char *argv[])
 	}
 }
 
+/* Command "dmesg": print what DBGOUT logged since the last time. */
+static void cmd_dmesg(int argc, char *argv[])
+{
+	if (!dbg_dump())
+		puts("(empty)\n");
+}
+
 /* Command "echo": It can accept a "-n" option. */
 static void cmd_echo(int argc, char* argv[])
 {
@@ -327,6 +421,53 @@ void cmd_history(int argc, char *argv[])
 	}
 }
 
+/* Print one row of I/O statistics. */
+static void show_io_stats(const char *name, const struct fio_stats_t *s)
+{
+	printf("%-8s %7u %7u %7u %9u %9u %7u\n", name, s->reads, s->writes,
+	       s->seeks, s->read_bytes, s->write_bytes, s->blocked_ticks);
+}
+
+/* Command "iostat" */
+static void cmd_iostat(int argc, char *argv[])
+{
+	struct fio_stats_t s;
+	struct serial_stats_t ss;
+	struct frame_stats_t fr;
+	char name[12];
+	const char *fs;
+	int i;
+
+	puts("fd         reads  writes   seeks    rbytes    wbytes blocked\n");
+	for (i = 0; i < MAX_FDS; i++) {
+		if (fio_get_stats(i, &s) < 0)
+			continue;
+		snprintf(name, sizeof(name), "%d", i);
+		show_io_stats(name, &s);
+	}
+	puts("fs\n");
+	for (i = 0; i < MAX_FS; i++) {
+		fs = fs_get_name(i);
+		if (fs && fio_get_fs_stats(i, &s) == 0)
+			show_io_stats(fs, &s);
+	}
+
+	for (i = 0; i < SERIAL_PORTS; i++) {
+		if (serial_get_stats(i, &ss) < 0)
+			continue;
+		printf("ttyS%d: rx %u tx %u dropped %u overflows %u overruns %u irqs %u\n",
+		       i, ss.rx_bytes, ss.tx_bytes, ss.rx_dropped, ss.rx_overflows,
+		       ss.rx_overruns, ss.irqs);
+	}
+	for (i = 0; i < SERIAL_PORTS; i++) {
+		if (frame_get_stats(i, &fr) < 0)
+			continue;
+		printf("frame%d: rx %u tx %u errors %u lost %u dups %u\n",
+		       i, fr.rx_frames, fr.tx_frames, fr.rx_errors,
+		       fr.rx_lost, fr.rx_dups);
+	}
+}
+
 /* Show 3 characters representing reading, writing and excuting. */
 static inline void show_access_rights(mode_t m, mode_t r, mode_t w, mode_t x)
 {
@@ -364,7 +505,7 @@ void cmd_ls(int argc, char *argv[])
 			show_access_rights(entry[i].mode, S_IRUSR, S_IWUSR, S_IXUSR);
 			show_access_rights(entry[i].mode, S_IRGRP, S_IWGRP, S_IXGRP);
 			show_access_rights(entry[i].mode, S_IROTH, S_IWOTH, S_IXOTH);
-			printf(" %s %u\n", entry[i].name, entry[i].size);
+			PRINTF_CONST(" %s %u\n", entry[i].name, entry[i].size);
 		}
 		else
 			printf("%s ", entry[i].name);
@@ -442,9 +583,7 @@ static void cmd_su(int argc, char *argv[])
 		if (user[0]) {
 			strcpy(buf + 5, user);
 			putenv_internal(buf);
-			fio_write(2, "Unknown id: ", 12);
-			fio_write(2, argv[1], strlen(argv[1]));
-			fio_write(2, "\n", 1);
+			dprintf(2, "Unknown id: %s\n", argv[1]);
 		}
 	}
 }
@@ -455,35 +594,30 @@ void shell_task(void *pvParameters)
 	char *user = NULL;
 	char *p = NULL;
 	char c;
+	int n;
 
 	sprintf(line, "USER=%s", "root");
 	putenv_internal(line);
 	user = getenv("USER");
 	for (;; cur_his = (cur_his + 1) % HISTORY_COUNT) {
 		p = cmd[cur_his];
-		printf("%s@FreeRTOS:%s# ", user, cwd);
 
-		while (1) {
-			fio_read(0, &c, 1);
+		/* stdin is canonical: the driver echoes and edits the line, and
+		 * each read returns at most one line ending with '\n'.
+		 */
+		do {
+			printf("%s@FreeRTOS:%s# ", user, cwd);
+			n = fio_read(0, p, CMDBUF_SIZE - 1);
+			if (n <= 0)
+				n = 0;
+			else if (p[n - 1] == '\n')
+				n--;
+			else
+				/* Drop the rest of a line too long for the buffer. */
+				while (fio_read(0, &c, 1) == 1 && c != '\n');
+		} while (n == 0);
+		p[n] = '\0';
 
-			if (c == '\r' || c == '\n') {
-				if (p > cmd[cur_his]) {
-					*p = '\0';
-					puts("\n");
-					break;
-				}
-			}
-			else if (c == 127 || c == '\b') {
-				if (p > cmd[cur_his]) {
-					p--;
-					puts("\b \b");
-				}
-			}
-			else if (p - cmd[cur_his] < CMDBUF_SIZE - 1) {
-				*p++ = c;
-				fio_write(1, &c, 1);
-			}
-		}
 		execute_command();
 	}
 }
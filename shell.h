@@ -13,11 +13,14 @@
 
 /* Enumeration for command types. */
 typedef enum {
-	CMD_cat = 0,
+	CMD_bench = 0,
+	CMD_cat,
+	CMD_dmesg,
 	CMD_echo,
 	CMD_export,
 	CMD_help,
 	CMD_history,
+	CMD_iostat,
 	CMD_ls,
 	CMD_man,
 	CMD_mmtest,
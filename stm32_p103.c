@@ -1,9 +1,11 @@
 #include "stm32_p103.h"
 #include "stm32f10x.h"
+#include "FreeRTOSConfig.h"
 #include "stm32f10x_gpio.h"
 #include "stm32f10x_rcc.h"
 #include "stm32f10x_usart.h"
 #include "stm32f10x_exti.h"
+#include "stm32f10x_dma.h"
 #include "misc.h"
 
 void init_led(void)
@@ -70,55 +72,237 @@ void enable_button_interrupts(void)
     NVIC_Init(&NVIC_InitStructure);
 }
 
-void init_rs232(void)
+/* Pins, clocks, DMA channels and interrupts of each USART. */
+struct rs232_hw_t {
+    USART_TypeDef *usart;
+    GPIO_TypeDef *gpio;
+    uint16_t tx_pin, rx_pin, cts_pin, rts_pin;
+    uint32_t gpio_clock;
+    uint32_t apb1_clock, apb2_clock;
+    DMA_Channel_TypeDef *tx_dma, *rx_dma;
+    uint32_t tx_dma_it, rx_dma_it;
+    uint8_t usart_irq, tx_dma_irq, rx_dma_irq;
+};
+
+static const struct rs232_hw_t rs232_hw[RS232_PORTS] = {
+    {
+        USART1, GPIOA, GPIO_Pin_9, GPIO_Pin_10, GPIO_Pin_11, GPIO_Pin_12,
+        RCC_APB2Periph_GPIOA, 0, RCC_APB2Periph_USART1,
+        DMA1_Channel4, DMA1_Channel5, DMA1_IT_GL4, DMA1_IT_GL5,
+        USART1_IRQn, DMA1_Channel4_IRQn, DMA1_Channel5_IRQn,
+    },
+    {
+        USART2, GPIOA, GPIO_Pin_2, GPIO_Pin_3, GPIO_Pin_0, GPIO_Pin_1,
+        RCC_APB2Periph_GPIOA, RCC_APB1Periph_USART2, 0,
+        DMA1_Channel7, DMA1_Channel6, DMA1_IT_GL7, DMA1_IT_GL6,
+        USART2_IRQn, DMA1_Channel7_IRQn, DMA1_Channel6_IRQn,
+    },
+    {
+        USART3, GPIOB, GPIO_Pin_10, GPIO_Pin_11, GPIO_Pin_13, GPIO_Pin_14,
+        RCC_APB2Periph_GPIOB, RCC_APB1Periph_USART3, 0,
+        DMA1_Channel2, DMA1_Channel3, DMA1_IT_GL2, DMA1_IT_GL3,
+        USART3_IRQn, DMA1_Channel2_IRQn, DMA1_Channel3_IRQn,
+    },
+};
+
+void init_rs232(int port, uint32_t baud)
 {
+    const struct rs232_hw_t *hw = &rs232_hw[port];
     USART_InitTypeDef USART_InitStructure;
     GPIO_InitTypeDef GPIO_InitStructure;
 
-    /* Enable peripheral clocks. */
-    RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA | RCC_APB2Periph_AFIO, ENABLE);
-    RCC_APB1PeriphClockCmd(RCC_APB1Periph_USART2, ENABLE);
+    /* Enable peripheral clocks.  USART1 sits on APB2, the others on APB1. */
+    RCC_APB2PeriphClockCmd(hw->gpio_clock | RCC_APB2Periph_AFIO | hw->apb2_clock, ENABLE);
+    if (hw->apb1_clock)
+        RCC_APB1PeriphClockCmd(hw->apb1_clock, ENABLE);
 
-    /* Configure USART2 Rx pin as floating input. */
-    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_3;
+    /* Configure the Rx pin as floating input. */
+    GPIO_InitStructure.GPIO_Pin = hw->rx_pin;
     GPIO_InitStructure.GPIO_Mode = GPIO_Mode_IN_FLOATING;
-    GPIO_Init(GPIOA, &GPIO_InitStructure);
+    GPIO_Init(hw->gpio, &GPIO_InitStructure);
 
-    /* Configure USART2 Tx as alternate function push-pull. */
-    GPIO_InitStructure.GPIO_Pin = GPIO_Pin_2;
+    /* Configure the Tx pin as alternate function push-pull. */
+    GPIO_InitStructure.GPIO_Pin = hw->tx_pin;
     GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
     GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF_PP;
-    GPIO_Init(GPIOA, &GPIO_InitStructure);
+    GPIO_Init(hw->gpio, &GPIO_InitStructure);
 
-    /* Configure the USART2 */
-    USART_InitStructure.USART_BaudRate = 9600;
+    /* Configure the USART */
+    USART_InitStructure.USART_BaudRate = baud;
     USART_InitStructure.USART_WordLength = USART_WordLength_8b;
     USART_InitStructure.USART_StopBits = USART_StopBits_1;
     USART_InitStructure.USART_Parity = USART_Parity_No;
     USART_InitStructure.USART_HardwareFlowControl = USART_HardwareFlowControl_None;
     USART_InitStructure.USART_Mode = USART_Mode_Rx | USART_Mode_Tx;
-    USART_Init(USART2, &USART_InitStructure);
-    USART_Cmd(USART2, ENABLE);
+    USART_Init(hw->usart, &USART_InitStructure);
+    USART_Cmd(hw->usart, ENABLE);
 }
 
-void enable_rs232_interrupts(void)
+static void enable_rs232_irq(uint8_t irq)
 {
     NVIC_InitTypeDef NVIC_InitStructure;
 
-    /* Enable transmit and receive interrupts for the USART2. */
-    USART_ITConfig(USART2, USART_IT_TXE, DISABLE);
-    USART_ITConfig(USART2, USART_IT_RXNE, ENABLE);
-
-    /* Enable the USART2 IRQ in the NVIC module (so that the USART2 interrupt
-     * handler is enabled). */
-    NVIC_InitStructure.NVIC_IRQChannel = USART2_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannel = irq;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = configLIBRARY_KERNEL_INTERRUPT_PRIORITY;
     NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0;
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
 }
 
-void enable_rs232(void)
+void enable_rs232_interrupts(int port)
+{
+    const struct rs232_hw_t *hw = &rs232_hw[port];
+
+    /* Bytes are moved by DMA in both directions, so only the idle line
+     * needs to interrupt.
+     */
+    USART_ITConfig(hw->usart, USART_IT_TXE, DISABLE);
+    USART_ITConfig(hw->usart, USART_IT_RXNE, DISABLE);
+    USART_ITConfig(hw->usart, USART_IT_IDLE, ENABLE);
+
+    /* Report overruns instead of silently losing bytes. */
+    USART_ITConfig(hw->usart, USART_IT_ERR, ENABLE);
+
+    /* Enable the USART IRQ in the NVIC module (so that the USART interrupt
+     * handler is enabled). */
+    enable_rs232_irq(hw->usart_irq);
+}
+
+void enable_rs232_rx_dma(int port, void *buf, uint16_t size)
+{
+    const struct rs232_hw_t *hw = &rs232_hw[port];
+    DMA_InitTypeDef DMA_InitStructure;
+
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+
+    /* Circular mode keeps the buffer refilling without software
+     * intervention.
+     */
+    DMA_DeInit(hw->rx_dma);
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t) &hw->usart->DR;
+    DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t) buf;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+    DMA_InitStructure.DMA_BufferSize = size;
+    DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+    DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+    DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+    DMA_Init(hw->rx_dma, &DMA_InitStructure);
+
+    /* Interrupt when the buffer is half and completely filled. */
+    DMA_ITConfig(hw->rx_dma, DMA_IT_HT | DMA_IT_TC, ENABLE);
+    enable_rs232_irq(hw->rx_dma_irq);
+
+    USART_DMACmd(hw->usart, USART_DMAReq_Rx, ENABLE);
+    DMA_Cmd(hw->rx_dma, ENABLE);
+}
+
+void enable_rs232_tx_dma(int port)
+{
+    const struct rs232_hw_t *hw = &rs232_hw[port];
+    DMA_InitTypeDef DMA_InitStructure;
+
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+
+    /* The memory address and length are filled in for each transfer. */
+    DMA_DeInit(hw->tx_dma);
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t) &hw->usart->DR;
+    DMA_InitStructure.DMA_MemoryBaseAddr = 0;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+    DMA_InitStructure.DMA_BufferSize = 0;
+    DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+    DMA_InitStructure.DMA_Priority = DMA_Priority_Medium;
+    DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+    DMA_Init(hw->tx_dma, &DMA_InitStructure);
+
+    DMA_ITConfig(hw->tx_dma, DMA_IT_TC, ENABLE);
+    enable_rs232_irq(hw->tx_dma_irq);
+
+    USART_DMACmd(hw->usart, USART_DMAReq_Tx, ENABLE);
+}
+
+void start_rs232_tx_dma(int port, const void *buf, uint16_t len)
+{
+    DMA_Channel_TypeDef *ch = rs232_hw[port].tx_dma;
+
+    DMA_Cmd(ch, DISABLE);
+    ch->CMAR = (uint32_t) buf;
+    DMA_SetCurrDataCounter(ch, len);
+    DMA_Cmd(ch, ENABLE);
+}
+
+uint16_t get_rs232_rx_dma_count(int port)
+{
+    return DMA_GetCurrDataCounter(rs232_hw[port].rx_dma);
+}
+
+void clear_rs232_rx_dma(int port)
+{
+    DMA_ClearITPendingBit(rs232_hw[port].rx_dma_it);
+}
+
+void clear_rs232_tx_dma(int port)
+{
+    DMA_ClearITPendingBit(rs232_hw[port].tx_dma_it);
+}
+
+int clear_rs232_interrupts(int port)
+{
+    USART_TypeDef *usart = rs232_hw[port].usart;
+    int overrun = USART_GetITStatus(usart, USART_IT_ORE) != RESET;
+
+    /* The IDLE and error flags are cleared by reading SR (done above)
+     * then DR.
+     */
+    USART_ReceiveData(usart);
+
+    return overrun;
+}
+
+void enable_rs232_flow_control(int port)
+{
+    const struct rs232_hw_t *hw = &rs232_hw[port];
+    GPIO_InitTypeDef GPIO_InitStructure;
+
+    /* Configure CTS as floating input. */
+    GPIO_InitStructure.GPIO_Pin = hw->cts_pin;
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_IN_FLOATING;
+    GPIO_Init(hw->gpio, &GPIO_InitStructure);
+
+    /* RTS is driven by software from the receive ring fill level, so it
+     * is a plain push-pull output, asserted (low) to start with.
+     */
+    GPIO_WriteBit(hw->gpio, hw->rts_pin, Bit_RESET);
+    GPIO_InitStructure.GPIO_Pin = hw->rts_pin;
+    GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+    GPIO_InitStructure.GPIO_Mode = GPIO_Mode_Out_PP;
+    GPIO_Init(hw->gpio, &GPIO_InitStructure);
+
+    /* Let the USART hold transmission while CTS is deasserted. */
+    hw->usart->CR3 |= USART_CR3_CTSE;
+}
+
+void disable_rs232_flow_control(int port)
+{
+    rs232_hw[port].usart->CR3 &= (uint16_t) ~USART_CR3_CTSE;
+}
+
+void set_rs232_rts(int port, int ready)
+{
+    const struct rs232_hw_t *hw = &rs232_hw[port];
+
+    GPIO_WriteBit(hw->gpio, hw->rts_pin, ready ? Bit_RESET : Bit_SET);
+}
+
+void enable_rs232(int port)
 {
     /* Enable the RS232 port. */
-    USART_Cmd(USART2, ENABLE);
+    USART_Cmd(rs232_hw[port].usart, ENABLE);
 }
@@ -1,6 +1,8 @@
 #ifndef __STM32_P103_H
 #define __STM32_P103_H
 
+#include <stdint.h>
+
 /* This library contains routines for interfacing with the STM32 P103 board. */
 
 /* Initialize the LED (the board only has one). */
@@ -9,18 +11,55 @@ void init_led(void);
 /* Initialize the button (the board only has one). */
 void init_button(void);
 
-/* Configures the RS232 serial port using the following settings:
- *   9600 Baud
+/* The board's USARTs, numbered as the serial driver sees them:
+ *   0: USART1 (PA9/PA10, CTS PA11, RTS PA12, DMA1 channels 4/5)
+ *   1: USART2 (PA2/PA3, CTS PA0, RTS PA1, DMA1 channels 7/6), the console
+ *   2: USART3 (PB10/PB11, CTS PB13, RTS PB14, DMA1 channels 2/3)
+ */
+#define RS232_PORTS 3
+
+/* Configures an RS232 serial port using the following settings:
+ *   The given baud rate
  *   8 bits + 1 stop bit
  *   No parity bit
  *   No hardware flow control
- * Note that the USART2 is not enabled in this routine.  It is left disabled in
+ * Note that the USART is not enabled in this routine.  It is left disabled in
  * case any additional configuration is needed.
  */
-void init_rs232(void);
+void init_rs232(int port, uint32_t baud);
+
+void enable_rs232_interrupts(int port);
 
-void enable_rs232_interrupts(void);
+/* Receive the port's data into buf by DMA in circular mode, interrupting
+ * at half and full buffer.
+ */
+void enable_rs232_rx_dma(int port, void *buf, uint16_t size);
+
+/* Prepare the port for transmission by DMA; each transfer is started with
+ * start_rs232_tx_dma().
+ */
+void enable_rs232_tx_dma(int port);
+
+/* Send len bytes from buf; the transmit DMA interrupt fires when done. */
+void start_rs232_tx_dma(int port, const void *buf, uint16_t len);
+
+/* Bytes the receive DMA still has to store before wrapping. */
+uint16_t get_rs232_rx_dma_count(int port);
+
+/* Clear the pending receive and transmit DMA interrupts. */
+void clear_rs232_rx_dma(int port);
+void clear_rs232_tx_dma(int port);
+
+/* Clear the idle line and error flags; returns nonzero on overrun. */
+int clear_rs232_interrupts(int port);
+
+/* RTS/CTS hardware flow control: CTS gates transmission in the USART, RTS
+ * is left to software through set_rs232_rts().
+ */
+void enable_rs232_flow_control(int port);
+void disable_rs232_flow_control(int port);
+void set_rs232_rts(int port, int ready);
 
-void enable_rs232(void);
+void enable_rs232(int port);
 
 #endif /* __STM32_P103_H */
@@ -1,9 +1,13 @@
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include "fio.h"
+#include "string-util.h"
+#include "word-util.h"
 
 typedef enum {
 	IOFMT_CHAR,
@@ -23,10 +27,25 @@ typedef struct {
 	IOFMT_TOKEN type;
 	char spec;
 	char width;
+	char prec;	/* -1 when not given */
+	char length;	/* number of 'l' modifiers */
 } output_token;
 
-typedef int (*putc_t)(void *param, char c);
-typedef int (*puts_t)(void *param, const char *s);
+/* Where the formatter's output goes.  Text collects in buf and is handed to
+ * flush a buffer at a time; a sink without flush writes straight into buf
+ * and drops what does not fit.
+ */
+typedef struct print_sink {
+	char *buf;
+	int size;
+	int len;
+	int count;	/* characters produced so far */
+	int (*flush)(struct print_sink *sink);
+	int fd;
+} print_sink;
+
+/* Stack buffer printf() and dprintf() format into. */
+#define PRINT_BUF_SIZE 64
 
 #define _CTYPE_DATA_0_127 \
 	_C,     _C,     _C,     _C,     _C,     _C,     _C,     _C, \
@@ -65,47 +84,59 @@ static const char ctype_table[128 + 256] = {
 };
 const char *__ctype_ptr__ = ctype_table + 127;
 
-static int _putc_printf(void *param, char c)
+static int fd_flush(print_sink *sink)
 {
-	int r = fio_write(1, &c, 1);
-
-	if (r > 0)
-		(*(int*)param)++;
-	return r;
+	return fio_write(sink->fd, sink->buf, sink->len);
 }
 
-static int _putc_sprintf(void *param, char c)
+static void sink_flush(print_sink *sink)
 {
-	*(*((char**)param))++ = c;
-	return 0;
+	if (sink->flush && sink->len)
+		sink->flush(sink);
+	sink->len = 0;
 }
 
-static int _puts_printf(void *param, const char *s)
+static void sink_write(print_sink *sink, const char *s, int n)
 {
-	int r = puts(s);
-
-	if (r > 0)
-		*(int*)param += strlen(s);
-	return r;
+	int span;
+
+	sink->count += n;
+	while (n > 0) {
+		if (sink->len == sink->size) {
+			if (!sink->flush)
+				return;
+			sink_flush(sink);
+		}
+		span = sink->size - sink->len;
+		if (span > n)
+			span = n;
+		memcpy(sink->buf + sink->len, s, span);
+		sink->len += span;
+		s += span;
+		n -= span;
+	}
 }
 
-static int _puts_sprintf(void *param, const char *s)
+static void sink_fill(print_sink *sink, char c, int n)
 {
-	char **p = (char**)param;
-
-	strcpy(*p, s);
-	*p += strlen(s);
-	return 0;
+	if (n <= 0)
+		return;
+	sink->count += n;
+	while (n-- > 0) {
+		if (sink->len == sink->size) {
+			if (!sink->flush)
+				return;
+			sink_flush(sink);
+		}
+		sink->buf[sink->len++] = c;
+	}
 }
 
 static output_token get_next_output_token(const char *fmt)
 {
-	output_token ret = {.fw_str = fmt, .type = IOFMT_UNKNOWN, .spec = '\0', .width = 0};
+	output_token ret = {.fw_str = fmt, .type = IOFMT_UNKNOWN, .spec = '\0', .width = 0, .prec = -1, .length = 0};
 
 	if (*ret.fw_str == '%') {
-		char width[8] = {0};
-		char *p = width;
-
 		ret.fw_str++;
 		if (*ret.fw_str == '-' || *ret.fw_str == '0')
 			ret.spec = *ret.fw_str++;
@@ -143,128 +174,344 @@ static output_token get_next_output_token(const char *fmt)
 				case 'x':
 					ret.type = IOFMT_xINT;
 				break;
+				case '.':
+					ret.prec = 0;
+				break;
+				case 'l':
+					ret.length++;
+				break;
+				case 'h':
+				case 'z':
+					/* Same size as int here. */
+				break;
+				case '0': case '1': case '2': case '3': case '4':
+				case '5': case '6': case '7': case '8': case '9':
+					if (ret.prec >= 0)
+						ret.prec = 10 * ret.prec + (*ret.fw_str - '0');
+					else
+						ret.width = 10 * ret.width + (*ret.fw_str - '0');
+				break;
 				default:
-					ret.width = 10 * ret.width + (*ret.fw_str - '0');
+					ret.type = IOFMT_ERROR;
 				break;
 			}
 		}
 	}
 	else {
+		/* A run of literal text, up to the next conversion. */
 		ret.type = IOFMT_TEXT;
-		ret.spec = *ret.fw_str++;
+		while (*ret.fw_str && *ret.fw_str != '%')
+			ret.fw_str++;
 	}
 
 	return ret;
 }
 
-static char *utoa(unsigned int num, char *dst, unsigned int base, int lowercase)
+static const char digit_pairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+/* Write num in decimal backwards, ending just before end.  Returns where it
+ * starts.  Two digits come from the table per step, and dividing by the
+ * constant 100 compiles to a multiplication.
+ */
+static char *utoa10(uint32_t num, char *end)
 {
-	char buf[33] = {0};
-	char *p = &buf[32];
+	const char *d;
+	char *p = end;
+
+	while (num >= 100) {
+		d = digit_pairs + 2 * (num % 100);
+		num /= 100;
+		*--p = d[1];
+		*--p = d[0];
+	}
+	if (num >= 10) {
+		d = digit_pairs + 2 * num;
+		*--p = d[1];
+		*--p = d[0];
+	}
+	else
+		*--p = '0' + num;
 
-	if (num == 0)
-		*--p = '0';
-	else {
-		char *q;
+	return p;
+}
+
+/* The same for hi:lo.  The high word is worked down 10000 at a time by
+ * long division in 16-bit steps, which needs only 32-bit divides; there is
+ * no 64-bit division routine to call.
+ */
+static char *ulltoa10(uint32_t hi, uint32_t lo, char *end)
+{
+	char *p = end;
+	uint32_t cur, r, q1;
+
+	while (hi) {
+		r = hi % 10000;
+		hi /= 10000;
+		cur = (r << 16) | (lo >> 16);
+		q1 = cur / 10000;
+		r = cur % 10000;
+		cur = (r << 16) | (lo & 0xFFFF);
+		lo = (q1 << 16) | (cur / 10000);
+		r = cur % 10000;
+		/* Four digits with their leading zeros. */
+		p = utoa10(r + 10000, p) + 1;
+	}
 
-		for (; num; num/=base)
-			*--p = "0123456789ABCDEF" [num % base];
-		if (lowercase)
-			for (q = p; *q; q++)
-				*q = (char)tolower(*q);
+	return utoa10(lo, p);
+}
+
+static char *ulltoa16(uint32_t hi, uint32_t lo, char *end, const char *digits)
+{
+	char *p = end;
+	int i;
+
+	if (hi) {
+		for (i = 0; i < 8; i++, lo >>= 4)
+			*--p = digits[lo & 15];
+		lo = hi;
 	}
+	do {
+		*--p = digits[lo & 15];
+		lo >>= 4;
+	} while (lo);
 
-	return strcpy(dst, p);
+	return p;
 }
 
-static int vprintf_core(const char *fmt, va_list arg_list, putc_t _putc_, puts_t _puts_, void *param)
+/* Parse fmt into at most max steps.  Returns how many, or -1 if it needs
+ * more or has text too long for a step.
+ */
+static int fmt_compile(const char *fmt, struct fmt_op_t *ops, int max)
 {
-	char buf[12];
+	const char *p = fmt;
+	const char *text;
 	output_token out;
-	union {
-		int i;
-		const char *s;
-		unsigned u;
-	} argv;
-
-	for (; *fmt; fmt = out.fw_str) {
-		int ret = 0;
-
-		out = get_next_output_token(fmt);
-		switch (out.type) {
-			case IOFMT_CHAR:
-				argv.i = va_arg(arg_list, int);
-				_putc_(param, (char)argv.i);
-				argv.s = NULL;
-			break;
-			case IOFMT_INT:
-				argv.i = va_arg(arg_list, int);
-				if (argv.i < 0) {
-					buf[0] = '-';
-					utoa(-argv.i, buf + 1, 10, 0);
-				}
-				else
-					utoa(argv.i, buf, 10, 0);
-				argv.s = buf;
-			break;
-			case IOFMT_PTR:
-				argv.u = va_arg(arg_list, unsigned);
-				if (argv.u) {
-					strcpy(buf, "0x");
-					utoa(argv.u, buf + 2, 16, 1);
-					argv.s = buf;
-				}
-				else
-					argv.s = "(nil)";
-			break;
-			case IOFMT_STR:
-				argv.s = va_arg(arg_list, const char *);
-				if (!argv.s)
-					argv.s = "(null)";
-			break;
-			case IOFMT_TEXT:
-				_putc_(param, out.spec);
-				argv.s = NULL;
-			break;
-			case IOFMT_UINT:
-				argv.u = va_arg(arg_list, unsigned);
-				utoa(argv.u, buf, 10, 0);
-				argv.s = buf;
-			break;
-			case IOFMT_XINT:
-				argv.u = va_arg(arg_list, unsigned);
-				utoa(argv.u, buf, 16, 0);
-				argv.s = buf;
-			break;
-			case IOFMT_xINT:
-				argv.u = va_arg(arg_list, unsigned);
-				utoa(argv.u, buf, 16, 1);
-				argv.s = buf;
-			break;
-			default:
-				argv.s = NULL;
-			break;
+	int n;
+
+	for (n = 0; n < max; n++) {
+		for (text = p; *p && *p != '%'; p++);
+		if (p - text > UINT8_MAX || text - fmt > UINT16_MAX)
+			return -1;
+		ops[n].text_off = text - fmt;
+		ops[n].text_len = p - text;
+		if (!*p) {
+			ops[n].type = IOFMT_UNKNOWN;
+			return n + 1;
 		}
-		if (argv.s) {
-			int w = out.width - strlen(argv.s);
-			if (out.spec == '-') {
-				_puts_(param, argv.s);
-				while (w-- > 0) {
-					_putc_(param, ' ');
-				}
+		out = get_next_output_token(p);
+		ops[n].type = out.type;
+		ops[n].spec = out.spec;
+		ops[n].width = out.width;
+		ops[n].prec = out.prec;
+		ops[n].length = out.length;
+		p = out.fw_str;
+	}
+
+	return -1;
+}
+
+/* Parsed formats, remembered by address. */
+#define FMT_CACHE_SIZE 4
+#define FMT_CACHE_OPS 8
+
+/* A format in RAM may be rewritten at the same address, so only formats in
+ * flash, below SRAM at 0x20000000, are remembered.
+ */
+#ifndef FMT_CACHEABLE
+#define FMT_CACHEABLE(fmt) ((uintptr_t)(fmt) < 0x20000000)
+#endif
+
+#define FMT_SLOT(fmt) (((uintptr_t)(fmt) >> 2) % FMT_CACHE_SIZE)
+
+/* Keeps the compiler from moving memory accesses across it. */
+#define barrier() __asm__ __volatile__("" ::: "memory")
+
+/* gen is odd while an entry is being written; a reader copies the steps out
+ * and trusts them only if gen did not change meanwhile.
+ */
+static struct {
+	volatile uint32_t gen;
+	const char *fmt;
+	int n;
+	struct fmt_op_t ops[FMT_CACHE_OPS];
+} fmt_cache[FMT_CACHE_SIZE];
+
+static int fmt_cache_get(const char *fmt, struct fmt_op_t *ops)
+{
+	int slot = FMT_SLOT(fmt);
+	uint32_t gen = fmt_cache[slot].gen;
+	int n;
+
+	barrier();
+	if ((gen & 1) || fmt_cache[slot].fmt != fmt)
+		return -1;
+	n = fmt_cache[slot].n;
+	memcpy(ops, fmt_cache[slot].ops, n * sizeof(*ops));
+	barrier();
+	if (fmt_cache[slot].gen != gen)
+		return -1;
+
+	return n;
+}
+
+static void fmt_cache_put(const char *fmt, const struct fmt_op_t *ops, int n)
+{
+	int slot = FMT_SLOT(fmt);
+	uint32_t gen = fmt_cache[slot].gen;
+
+	if (!FMT_CACHEABLE(fmt) || (gen & 1))
+		return;
+	/* Whoever loses the race for the entry leaves it alone. */
+	if (!__sync_bool_compare_and_swap(&fmt_cache[slot].gen, gen, gen + 1))
+		return;
+	fmt_cache[slot].fmt = fmt;
+	fmt_cache[slot].n = n;
+	memcpy(fmt_cache[slot].ops, ops, n * sizeof(*ops));
+	barrier();
+	fmt_cache[slot].gen = gen + 2;
+}
+
+/* Output one conversion, taking its argument from ap. */
+static void fmt_convert(print_sink *sink, const struct fmt_op_t *op, va_list *ap)
+{
+	char buf[24];
+	char *end = buf + sizeof(buf);
+	const char *s;
+	const char *prefix = "";
+	unsigned long long v;
+	int len, zeros = 0, w;
+
+	switch (op->type) {
+		case IOFMT_CHAR:
+			buf[0] = (char)va_arg(*ap, int);
+			s = buf;
+			len = 1;
+		break;
+		case IOFMT_STR:
+			s = va_arg(*ap, const char *);
+			if (!s)
+				s = "(null)";
+			if (op->prec >= 0)
+				for (len = 0; len < op->prec && s[len]; len++);
+			else
+				len = strlen(s);
+		break;
+		case IOFMT_PTR:
+			v = (uintptr_t)va_arg(*ap, void *);
+			if (v) {
+				prefix = "0x";
+				s = ulltoa16(0, v, end, "0123456789abcdef");
+				len = end - s;
 			}
 			else {
-				if (!out.spec)
-					out.spec = ' ';
-				while (w-- > 0) {
-					_putc_(param, out.spec);
-				}
-				_puts_(param, argv.s);
+				s = "(nil)";
+				len = 5;
+			}
+		break;
+		case IOFMT_INT:
+		case IOFMT_UINT:
+		case IOFMT_XINT:
+		case IOFMT_xINT:
+			if (op->length >= 2)
+				v = va_arg(*ap, unsigned long long);
+			else if (op->type == IOFMT_INT)
+				v = (long long)va_arg(*ap, int);
+			else
+				v = va_arg(*ap, unsigned);
+			if (op->type == IOFMT_INT && (long long)v < 0) {
+				prefix = "-";
+				v = -v;
+			}
+
+			if (op->type == IOFMT_XINT)
+				s = ulltoa16(v >> 32, v, end, "0123456789ABCDEF");
+			else if (op->type == IOFMT_xINT)
+				s = ulltoa16(v >> 32, v, end, "0123456789abcdef");
+			else
+				s = ulltoa10(v >> 32, v, end);
+			len = end - s;
+
+			/* A precision is the least number of digits, and zero
+			 * shown with none is nothing at all.
+			 */
+			if (op->prec == 0 && !v)
+				len = 0;
+			if (op->prec >= 0)
+				zeros = op->prec - len;
+			else if (op->spec == '0')
+				zeros = op->width - len - strlen(prefix);
+		break;
+		case IOFMT_TEXT:
+			/* "%%" goes out without padding. */
+			sink_write(sink, "%", 1);
+			return;
+		default:
+			return;
+	}
+
+	if (zeros < 0)
+		zeros = 0;
+	w = op->width - strlen(prefix) - zeros - len;
+	if (op->spec != '-')
+		sink_fill(sink, ' ', w);
+	sink_write(sink, prefix, strlen(prefix));
+	sink_fill(sink, '0', zeros);
+	sink_write(sink, s, len);
+	if (op->spec == '-')
+		sink_fill(sink, ' ', w);
+}
+
+static void fmt_run(const char *fmt, const struct fmt_op_t *ops, int n, va_list *ap, print_sink *sink)
+{
+	for (; n > 0; n--, ops++) {
+		sink_write(sink, fmt + ops->text_off, ops->text_len);
+		fmt_convert(sink, ops, ap);
+	}
+}
+
+static int vprintf_core(const char *fmt, va_list arg_list, print_sink *sink)
+{
+	struct fmt_op_t ops[FMT_CACHE_OPS];
+	output_token out;
+	va_list ap;
+	int n;
+
+	va_copy(ap, arg_list);
+	n = fmt_cache_get(fmt, ops);
+	if (n < 0 && (n = fmt_compile(fmt, ops, FMT_CACHE_OPS)) > 0)
+		fmt_cache_put(fmt, ops, n);
+
+	if (n > 0)
+		fmt_run(fmt, ops, n, &ap, sink);
+	else {
+		/* Too long to keep: parse it as it goes out. */
+		for (; *fmt; fmt = out.fw_str) {
+			out = get_next_output_token(fmt);
+			if (out.type == IOFMT_TEXT && out.spec != '%') {
+				sink_write(sink, fmt, out.fw_str - fmt);
+				continue;
 			}
+			ops[0].type = out.type;
+			ops[0].spec = out.spec;
+			ops[0].width = out.width;
+			ops[0].prec = out.prec;
+			ops[0].length = out.length;
+			fmt_convert(sink, ops, &ap);
 		}
 	}
+	va_end(ap);
 
-	return 0;
+	return sink->count;
 }
 
 int *__errno()
@@ -272,13 +519,61 @@ int *__errno()
 	return &error_n;
 }
 
+static int vdprintf_core(int fd, const char *fmt, va_list arg_list)
+{
+	char buf[PRINT_BUF_SIZE];
+	print_sink sink = {.buf = buf, .size = sizeof(buf), .flush = fd_flush, .fd = fd};
+
+	vprintf_core(fmt, arg_list, &sink);
+	sink_flush(&sink);
+
+	return sink.count;
+}
+
 int printf(const char *fmt, ...)
 {
-	int count = 0;
+	int count;
 	va_list arg_list;
 
 	va_start(arg_list, fmt);
-	vprintf_core(fmt, arg_list, _putc_printf, _puts_printf, &count);
+	count = vdprintf_core(1, fmt, arg_list);
+	va_end(arg_list);
+
+	return count;
+}
+
+int fmt_printf(struct fmt_const_t *fc, ...)
+{
+	char buf[PRINT_BUF_SIZE];
+	print_sink sink = {.buf = buf, .size = sizeof(buf), .flush = fd_flush, .fd = 1};
+	va_list arg_list;
+	int n = fc->n;
+
+	if (!n) {
+		/* Tasks that race here store the same steps. */
+		n = fmt_compile(fc->fmt, fc->op, FMT_CONST_OPS);
+		barrier();
+		fc->n = n;
+	}
+
+	va_start(arg_list, fc);
+	if (n > 0)
+		fmt_run(fc->fmt, fc->op, n, &arg_list, &sink);
+	else
+		vprintf_core(fc->fmt, arg_list, &sink);
+	va_end(arg_list);
+	sink_flush(&sink);
+
+	return sink.count;
+}
+
+int dprintf(int fd, const char *fmt, ...)
+{
+	int count;
+	va_list arg_list;
+
+	va_start(arg_list, fmt);
+	count = vdprintf_core(fd, fmt, arg_list);
 	va_end(arg_list);
 
 	return count;
@@ -292,82 +587,148 @@ int puts(const char *s)
 
 int sprintf(char *dst, const char *fmt, ...)
 {
-	char *p = dst;
+	print_sink sink = {.buf = dst, .size = INT_MAX};
 	va_list arg_list;
 
 	va_start(arg_list, fmt);
-	vprintf_core(fmt, arg_list, _putc_sprintf, _puts_sprintf, &p);
+	vprintf_core(fmt, arg_list, &sink);
 	va_end(arg_list);
-	*p = '\0';
+	dst[sink.len] = '\0';
 
-	return p - dst;
+	return sink.count;
 }
 
-char *strcat(char *dst, const char *src)
+/* Write at most size - 1 characters and always terminate, if size allows.
+ * Returns the length the whole output would have had.
+ */
+int vsnprintf(char *dst, size_t size, const char *fmt, va_list arg_list)
 {
-	char *ret = dst;
+	print_sink sink = {.buf = dst, .size = size ? size - 1 : 0};
 
-	for (; *dst; ++dst);
-	while ((*dst++ = *src++));
+	vprintf_core(fmt, arg_list, &sink);
+	if (size)
+		dst[sink.len] = '\0';
 
-	return ret;
+	return sink.count;
+}
+
+int snprintf(char *dst, size_t size, const char *fmt, ...)
+{
+	int count;
+	va_list arg_list;
+
+	va_start(arg_list, fmt);
+	count = vsnprintf(dst, size, fmt, arg_list);
+	va_end(arg_list);
+
+	return count;
+}
+
+/* The routines below go a word at a time once the pointers are aligned.
+ * An aligned word never spans the end of a memory region, so reading the
+ * whole word around a terminator is safe.
+ */
+
+char *strcat(char *dst, const char *src)
+{
+	strcpy(dst + strlen(dst), src);
+	return dst;
 }
 
 char *strchr(const char *s, int c)
 {
-	for (; *s && *s != c; s++);
-	return (*s == c) ? (char *)s : NULL;
+	const word_t *w;
+	size_t k;
+
+	c = (unsigned char)c;
+	if (!c)
+		return (char *)s + strlen(s);
+
+	for (; (uintptr_t)s % ALIGN; s++) {
+		if (*(unsigned char *)s == c)
+			return (char *)s;
+		if (!*s)
+			return NULL;
+	}
+	k = ONES * c;
+	for (w = (const void *)s; !HASZERO(*w) && !HASZERO(*w ^ k); w++);
+	for (s = (const void *)w; *s && *(unsigned char *)s != c; s++);
+
+	return *(unsigned char *)s == c ? (char *)s : NULL;
 }
 
-int strcmp(const char *a, const char *b) __attribute__ ((naked));
-int strcmp(const char *a, const char *b)
+int strcmp(const char *l, const char *r)
 {
-	asm(
-	"strcmp_lop:                \n"
-	"   ldrb    r2, [r0],#1     \n"
-	"   ldrb    r3, [r1],#1     \n"
-	"   cmp     r2, #1          \n"
-	"   it      hi              \n"
-	"   cmphi   r2, r3          \n"
-	"   beq     strcmp_lop      \n"
-		"       sub     r0, r2, r3      \n"
-	"   bx      lr              \n"
-		:::
-	);
+	const word_t *wl, *wr;
+
+	/* Words can be compared only if both strings are equally aligned. */
+	if (((uintptr_t)l - (uintptr_t)r) % ALIGN == 0) {
+		for (; (uintptr_t)l % ALIGN; l++, r++)
+			if (*l != *r || !*l)
+				return *(unsigned char *)l - *(unsigned char *)r;
+		wl = (const void *)l;
+		wr = (const void *)r;
+		for (; *wl == *wr && !HASZERO(*wl); wl++, wr++);
+		l = (const void *)wl;
+		r = (const void *)wr;
+	}
+	for (; *l == *r && *l; l++, r++);
+
+	return *(unsigned char *)l - *(unsigned char *)r;
 }
 
 char *strcpy(char *dest, const char *src)
 {
-	const char *s = src;
 	char *d = dest;
-	while ((*d++ = *s++));
+	word_t *wd;
+	const word_t *ws;
+
+	if (((uintptr_t)d - (uintptr_t)src) % ALIGN == 0) {
+		for (; (uintptr_t)src % ALIGN; src++, d++)
+			if (!(*d = *src))
+				return dest;
+		wd = (void *)d;
+		ws = (const void *)src;
+		for (; !HASZERO(*ws); *wd++ = *ws++);
+		d = (void *)wd;
+		src = (const void *)ws;
+	}
+	while ((*d++ = *src++));
+
 	return dest;
 }
 
-size_t strlen(const char *s) __attribute__ ((naked));
 size_t strlen(const char *s)
 {
-	asm(
-		"       sub  r3, r0, #1                 \n"
-	"strlen_loop:               \n"
-		"       ldrb r2, [r3, #1]!              \n"
-		"       cmp  r2, #0                             \n"
-	"   bne  strlen_loop        \n"
-		"       sub  r0, r3, r0                 \n"
-		"       bx   lr                                 \n"
-		:::
-	);
+	const char *a = s;
+	const word_t *w;
+
+	for (; (uintptr_t)s % ALIGN; s++)
+		if (!*s)
+			return s - a;
+	for (w = (const void *)s; !HASZERO(*w); w++);
+	for (s = (const void *)w; *s; s++);
+
+	return s - a;
 }
 
-int strncmp(const char *a, const char *b, size_t n)
+int strncmp(const char *l, const char *r, size_t n)
 {
-	size_t i;
-
-	for (i = 0; i < n; i++)
-		if (a[i] != b[i])
-			return a[i] - b[i];
+	const word_t *wl, *wr;
+
+	if (((uintptr_t)l - (uintptr_t)r) % ALIGN == 0) {
+		for (; n && (uintptr_t)l % ALIGN; l++, r++, n--)
+			if (*l != *r || !*l)
+				return *(unsigned char *)l - *(unsigned char *)r;
+		wl = (const void *)l;
+		wr = (const void *)r;
+		for (; n >= SS && *wl == *wr && !HASZERO(*wl); wl++, wr++, n -= SS);
+		l = (const void *)wl;
+		r = (const void *)wr;
+	}
+	for (; n && *l == *r && *l; l++, r++, n--);
 
-	return 0;
+	return n ? *(unsigned char *)l - *(unsigned char *)r : 0;
 }
 
 char *strncpy(char *dest, const char *src, size_t n)
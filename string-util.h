@@ -0,0 +1,42 @@
+#ifndef __STRING_UTIL_H__
+#define __STRING_UTIL_H__
+
+#include <stdint.h>
+
+/* A format string parsed ahead of time by string-util.c.  Each step is a
+ * run of literal text, kept as an offset into the format, followed by one
+ * conversion.
+ */
+struct fmt_op_t {
+	uint16_t text_off;
+	uint8_t text_len;
+	uint8_t type;
+	char spec;
+	char width;
+	char prec;
+	char length;
+};
+
+/* Steps kept for a PRINTF_CONST call site; a format needing more is parsed
+ * on every call instead.
+ */
+#define FMT_CONST_OPS 6
+
+struct fmt_const_t {
+	const char *fmt;
+	int8_t n;	/* 0 until parsed, -1 if it did not fit */
+	struct fmt_op_t op[FMT_CONST_OPS];
+};
+
+int fmt_printf(struct fmt_const_t *fc, ...);
+
+/* printf() for a constant format.  The format is parsed the first time the
+ * line runs and the steps stay beside it, so later calls only convert their
+ * arguments.
+ */
+#define PRINTF_CONST(fmt, ...) ({ \
+	static struct fmt_const_t fmt_const_ = {fmt}; \
+	fmt_printf(&fmt_const_, ##__VA_ARGS__); \
+})
+
+#endif
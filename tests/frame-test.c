@@ -0,0 +1,224 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libc-test.h"
+#include "frame.h"
+
+/* Test of the frame codec and receiver (frame.c) shared by the target and
+ * the host tools: the CRC against its check value, encode and decode round
+ * trips, single-bit errors, and a noisy stream with lost and repeated
+ * frames fed to frame_rx_next() in uneven pieces, and a benchmark of
+ * the codec.
+ *   frame-test        check, exit status 1 on any mismatch
+ *   frame-test -b     benchmark
+ */
+
+#define FRAMES 20000
+
+static void random_payload(uint8_t * p, int len) {
+    int i;
+
+    /* Zeros and runs of 0xFF are what COBS has to get right. */
+    for (i = 0; i < len; i++) {
+        switch (rand() % 4) {
+        case 0:
+            p[i] = 0;
+            break;
+        case 1:
+            p[i] = 0xFF;
+            break;
+        default:
+            p[i] = rand();
+            break;
+        }
+    }
+}
+
+static void check_crc() {
+    if (frame_crc16(0xFFFF, (const uint8_t *) "123456789", 9) != 0x29B1)
+        fail("CRC-16/CCITT check value");
+}
+
+/* Encoded frames hold no zero but the delimiter, fit FRAME_ENC_SIZE and
+ * decode to what went in.
+ */
+static void check_round_trip(int step) {
+    uint8_t payload[FRAME_MTU];
+    uint8_t enc[FRAME_ENC_MAX];
+    uint8_t seq = rand();
+    uint8_t got_seq;
+    int len = step % (FRAME_MTU + 1);
+    int n, i;
+
+    random_payload(payload, len);
+    n = frame_encode(seq, payload, len, enc);
+    if (n > FRAME_ENC_SIZE(len))
+        fail("encoded too long: step %d length %d", step, len);
+    if (enc[n - 1])
+        fail("no delimiter: step %d length %d", step, len);
+    for (i = 0; i < n - 1; i++)
+        if (!enc[i])
+            fail("zero inside frame: step %d length %d", step, len);
+
+    if (frame_decode(enc, n - 1, &got_seq) != len || got_seq != seq || memcmp(enc, payload, len))
+        fail("round trip: step %d length %d", step, len);
+}
+
+/* Flip one bit of a byte that carries data, not a COBS length, so that the
+ * decoded frame differs in one bit: the CRC must catch it.
+ */
+static void check_bit_error(int step) {
+    uint8_t payload[FRAME_MTU];
+    uint8_t enc[FRAME_ENC_MAX];
+    uint8_t is_code[FRAME_ENC_MAX] = { 0 };
+    uint8_t seq;
+    int len = rand() % (FRAME_MTU + 1);
+    int n, i, pos;
+
+    random_payload(payload, len);
+    n = frame_encode(rand(), payload, len, enc);
+    for (pos = 0; pos < n - 1; pos += enc[pos])
+        is_code[pos] = 1;
+
+    do {
+        i = rand() % (n - 1);
+    } while (is_code[i] || enc[i] == (1 << (step % 8)));
+    enc[i] ^= 1 << (step % 8);
+
+    if (frame_decode(enc, n - 1, &seq) >= 0)
+        fail("bit error accepted: step %d length %d", step, len);
+}
+
+/* A stream of frames with some dropped, some sent twice, noise and idle
+ * delimiters between them, received in pieces of random size.
+ */
+static void check_stream() {
+    static uint8_t stream[FRAMES * (FRAME_ENC_MAX + 8) * 2];
+    static uint8_t sent[FRAMES][FRAME_MTU];
+    static int sent_len[FRAMES];
+    static int sent_ok[FRAMES];
+    struct frame_rx_t rx;
+    uint8_t enc[FRAME_ENC_MAX];
+    uint8_t buf[FRAME_MTU];
+    uint32_t lost = 0, dups = 0, noise = 0;
+    int pos = 0, fed = 0, next = 0;
+    int i, n, chunk;
+
+    for (i = 0; i < FRAMES; i++) {
+        sent_len[i] = rand() % (FRAME_MTU + 1);
+        random_payload(sent[i], sent_len[i]);
+        n = frame_encode(i, sent[i], sent_len[i], enc);
+
+        switch (rand() % 16) {
+        case 0:
+            /* Dropped on the line. */
+            sent_ok[i] = 0;
+            lost++;
+            continue;
+        case 1:
+            memcpy(stream + pos, enc, n);
+            pos += n;
+            dups++;
+            break;
+        case 2:
+            /* Garbage ending in a delimiter. */
+            chunk = rand() % 40 + 1;
+            while (chunk--)
+                stream[pos++] = rand() % 255 + 1;
+            stream[pos++] = 0;
+            noise++;
+            break;
+        case 3:
+            stream[pos++] = 0;
+            break;
+        }
+        memcpy(stream + pos, enc, n);
+        pos += n;
+        sent_ok[i] = 1;
+    }
+    /* Frames dropped at the end are never missed. */
+    for (i = FRAMES - 1; !sent_ok[i]; i--)
+        lost--;
+
+    memset(&rx, 0, sizeof(rx));
+    while (fed < pos || (n = frame_rx_next(&rx, buf, sizeof(buf))) >= 0) {
+        if (fed < pos && (n = frame_rx_next(&rx, buf, sizeof(buf))) < 0) {
+            chunk = rand() % 64 + 1;
+            if (chunk > (int) sizeof(rx.buf) - rx.len)
+                chunk = sizeof(rx.buf) - rx.len;
+            if (chunk > pos - fed)
+                chunk = pos - fed;
+            memcpy(rx.buf + rx.len, stream + fed, chunk);
+            rx.len += chunk;
+            fed += chunk;
+            continue;
+        }
+
+        while (next < FRAMES && !sent_ok[next])
+            next++;
+        if (next == FRAMES || n != sent_len[next] || memcmp(buf, sent[next], n)) {
+            fail("stream payload: frame %d length %d", next, n);
+            return;
+        }
+        next++;
+    }
+
+    while (next < FRAMES && !sent_ok[next])
+        next++;
+    if (next != FRAMES)
+        fail("stream ended at frame %d", next);
+    if (rx.lost != lost)
+        fail("lost count %u, sent %u", rx.lost, lost);
+    if (rx.dups != dups)
+        fail("duplicate count %u, sent %u", rx.dups, dups);
+    if (rx.errors < noise)
+        fail("error count %u, sent %u bad", rx.errors, noise);
+}
+
+void check() {
+    int i;
+
+    check_crc();
+    for (i = 0; i < FRAMES; i++) {
+        check_round_trip(i);
+        check_bit_error(i);
+    }
+    check_stream();
+}
+
+struct bench_frame_t {
+    uint8_t payload[FRAME_MTU];
+    uint8_t enc[FRAME_ENC_MAX];
+    int len;
+};
+
+static void run_encode(void * arg) {
+    struct bench_frame_t * f = arg;
+
+    frame_encode(0, f->payload, f->len, f->enc);
+}
+
+static void run_round_trip(void * arg) {
+    struct bench_frame_t * f = arg;
+    uint8_t seq;
+
+    frame_decode(f->enc, frame_encode(0, f->payload, f->len, f->enc) - 1, &seq);
+}
+
+void bench() {
+    static const int lengths[] = { 1, 16, 64, FRAME_MTU };
+    struct bench_frame_t f;
+    double encode, round_trip;
+    int i;
+
+    printf("%-8s %10s %10s %14s\n", "payload", "encode ns", "decode ns", "decode MB/s");
+    for (i = 0; i < (int) (sizeof(lengths) / sizeof(lengths[0])); i++) {
+        f.len = lengths[i];
+        random_payload(f.payload, f.len);
+        encode = bench_ns(run_encode, &f);
+        round_trip = bench_ns(run_round_trip, &f);
+        printf("%-8d %10.1f %10.1f %14.1f\n", f.len, encode, round_trip - encode,
+               f.len * 1e3 / (round_trip - encode));
+    }
+}
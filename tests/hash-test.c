@@ -0,0 +1,156 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "libc-test.h"
+#include "hash-djb2.h"
+#include "hash-paths.h"
+
+/* Test of hash_murmur3 against a byte at a time model and the published
+ * values, of the generated hash-paths.h against hash_djb2 and
+ * hash_murmur3, and a benchmark of the two hashes on romfs paths.
+ *   hash-test        check, exit status 1 on any mismatch
+ *   hash-test -b     benchmark
+ */
+
+#define MAX_LEN 70
+
+uint32_t hash_murmur3(const uint8_t * str, ssize_t max);
+
+static uint32_t rotl(uint32_t x, int r) {
+    return (x << r) | (x >> (32 - r));
+}
+
+/* MurmurHash3 x86_32 as published, on len bytes, seed 0. */
+static uint32_t model(const uint8_t * p, int len) {
+    uint32_t h = 0;
+    uint32_t k;
+    int i, j;
+
+    for (i = 0; i + 4 <= len; i += 4) {
+        k = p[i] | (p[i + 1] << 8) | (p[i + 2] << 16) | ((uint32_t) p[i + 3] << 24);
+        h ^= rotl(k * 0xcc9e2d51, 15) * 0x1b873593;
+        h = rotl(h, 13) * 5 + 0xe6546b64;
+    }
+    if (len & 3) {
+        k = 0;
+        for (j = len & 3; j--; )
+            k = (k << 8) | p[i + j];
+        h ^= rotl(k * 0xcc9e2d51, 15) * 0x1b873593;
+    }
+
+    h ^= len;
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    return h ^ (h >> 16);
+}
+
+static void check_vectors() {
+    static const struct {
+        const char * s;
+        uint32_t h;
+    } vectors[] = {
+        { "", 0 },
+        { "test", 0xba6bd213 },
+        { "Hello, world!", 0xc0363e43 },
+        { "The quick brown fox jumps over the lazy dog", 0x2e4ff723 },
+    };
+    int i;
+
+    for (i = 0; i < (int) (sizeof(vectors) / sizeof(vectors[0])); i++)
+        if (hash_murmur3((const uint8_t *) vectors[i].s, -1) != vectors[i].h)
+            fail("\"%s\": wrong hash", vectors[i].s);
+}
+
+/* A string of len bytes at each alignment, hashed up to its terminator and
+ * with limits short of, at and past it.  The string ends a page, so
+ * reading beyond the terminator faults.
+ */
+static void check_string(int len) {
+    uint8_t * buf = guarded_alloc(MAX_LEN + 4);
+    uint8_t * s;
+    long max;
+    int align, i, n;
+
+    for (align = 0; align < 4; align++) {
+        s = buf + MAX_LEN + 4 - (len + 1) - align;
+        for (i = 0; i < len; i++)
+            s[i] = rand() % 255 + 1;
+        s[len] = '\0';
+
+        if (hash_murmur3(s, -1) != model(s, len))
+            fail("terminated: length %d align %d", len, align);
+        for (max = 0; max <= len + 2; max++) {
+            n = max < len ? max : len;
+            if (hash_murmur3(s, max) != model(s, n))
+                fail("limited: length %d align %d max %ld", len, align, max);
+        }
+    }
+
+    guarded_free(buf, MAX_LEN + 4);
+}
+
+/* The generated hash-paths.h against the hashes the firmware computes at
+ * run time: djb2 for devfs names, murmur3 for mount points.
+ */
+static void check_generated() {
+    static const struct {
+        const char * s;
+        uint32_t h;
+    } paths[] = {
+        { "stdin", stdin_hash }, { "stdout", stdout_hash }, { "stderr", stderr_hash },
+        { "ttyS0", ttyS0_hash }, { "ttyS1", ttyS1_hash }, { "ttyS2", ttyS2_hash },
+        { "frame0", frame0_hash }, { "frame1", frame1_hash }, { "frame2", frame2_hash },
+    }, mounts[] = {
+        { "dev", dev_mount_hash }, { "romfs", romfs_mount_hash },
+    };
+    int i;
+
+    for (i = 0; i < (int) (sizeof(paths) / sizeof(paths[0])); i++)
+        if (paths[i].h != hash_djb2((const uint8_t *) paths[i].s, -1))
+            fail("%s_hash", paths[i].s);
+    for (i = 0; i < (int) (sizeof(mounts) / sizeof(mounts[0])); i++)
+        if (mounts[i].h != hash_murmur3((const uint8_t *) mounts[i].s, -1))
+            fail("%s_mount_hash", mounts[i].s);
+}
+
+void check() {
+    int i, len;
+
+    check_vectors();
+    check_generated();
+    for (i = 0; i < 50; i++)
+        for (len = 0; len <= MAX_LEN; len++)
+            check_string(len);
+}
+
+typedef uint32_t (*hash_t)(const uint8_t *, ssize_t);
+
+static volatile hash_t fn_hash;
+
+static void run_hash(void * p) {
+    fn_hash(p, -1);
+}
+
+void bench() {
+    static const char * paths[] = {
+        "test.txt",
+        "index.html",
+        "www/images/background.png",
+        "a/much/longer/path/into/the/image/than/usual.txt",
+    };
+    double murmur3, djb2;
+    int i;
+
+    printf("%-48s %10s %10s\n", "path", "murmur3 ns", "djb2 ns");
+    for (i = 0; i < (int) (sizeof(paths) / sizeof(paths[0])); i++) {
+        fn_hash = hash_murmur3;
+        murmur3 = bench_ns(run_hash, (void *) paths[i]);
+        fn_hash = hash_djb2;
+        djb2 = bench_ns(run_hash, (void *) paths[i]);
+        printf("%-48s %10.1f %10.1f\n", paths[i], murmur3, djb2);
+    }
+}
@@ -0,0 +1,243 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libc-test.h"
+
+/* Test of the TLSF heap (heap_tlsf.c) under random allocation and freeing,
+ * and a benchmark of it next to heap_4.c on the same sequence of requests.
+ *   heap-test        check, exit status 1 on any error
+ *   heap-test -b     benchmark
+ *
+ * Both heaps are built with configTOTAL_HEAP_SIZE from FreeRTOSConfig.h
+ * under names of their own, see the Makefile.
+ */
+
+#define LIVE 64
+#define STEPS 200000
+
+struct heap_t {
+    const char * name;
+    void * (*malloc)(size_t);
+    void (*free)(void *);
+    size_t (*free_size)(void);
+};
+
+void * tlsf_malloc(size_t size);
+void tlsf_free(void * p);
+size_t tlsf_free_size(void);
+void * heap4_malloc(size_t size);
+void heap4_free(void * p);
+size_t heap4_free_size(void);
+
+static const struct heap_t tlsf = { "heap_tlsf", tlsf_malloc, tlsf_free, tlsf_free_size };
+static const struct heap_t heap4 = { "heap_4", heap4_malloc, heap4_free, heap4_free_size };
+
+/* What the heaps need from the kernel. */
+void vTaskSuspendAll(void) {
+}
+
+long xTaskResumeAll(void) {
+    return 0;
+}
+
+struct block_t {
+    uint8_t * p;
+    size_t size;
+    uint8_t fill;
+};
+
+/* Mostly small requests, some of the 256 to 2047 bytes mmtest asks for,
+ * and now and then one too large to be met.
+ */
+static size_t random_size() {
+    switch (rand() % 8) {
+    case 0:
+    case 1:
+    case 2:
+        return rand() % 64 + 1;
+    case 3:
+        return rand() % 16384;
+    default:
+        return rand() % 1792 + 256;
+    }
+}
+
+static void check_free(struct block_t * b, int step) {
+    size_t i;
+
+    for (i = 0; i < b->size; i++)
+        if (b->p[i] != (uint8_t) (b->fill + i)) {
+            fail("block overwritten: step %d size %zu", step, b->size);
+            break;
+        }
+    tlsf_free(b->p);
+    b->p = NULL;
+}
+
+/* Blocks come back aligned, do not overlap and keep their contents, and
+ * the free count adds up.  Once everything is freed the heap is one block
+ * again.
+ */
+void check() {
+    struct block_t live[LIVE] = { { 0 } };
+    struct block_t * b;
+    size_t initial, size;
+    long allocs[2] = { 0 };
+    int step, i;
+
+    tlsf_free(tlsf_malloc(1));
+    initial = tlsf_free_size();
+
+    for (step = 0; step < STEPS; step++) {
+        b = &live[rand() % LIVE];
+        if (b->p) {
+            check_free(b, step);
+            continue;
+        }
+
+        b->size = random_size();
+        b->p = tlsf_malloc(b->size);
+        if (!b->p) {
+            allocs[1]++;
+            continue;
+        }
+        allocs[0]++;
+        if (b->size == 0 || b->size > initial)
+            fail("malloc of an impossible size: step %d size %zu", step, b->size);
+        if ((uintptr_t) b->p % 8)
+            fail("misaligned: step %d size %zu", step, b->size);
+        for (i = 0; i < LIVE; i++)
+            if (live[i].p && &live[i] != b &&
+                b->p < live[i].p + live[i].size && live[i].p < b->p + b->size)
+                fail("overlap: step %d size %zu", step, b->size);
+        b->fill = rand();
+        for (i = 0; i < (int) b->size; i++)
+            b->p[i] = b->fill + i;
+    }
+
+    for (i = 0; i < LIVE; i++)
+        if (live[i].p)
+            check_free(&live[i], STEPS);
+    if (tlsf_free_size() != initial)
+        fail("free bytes lost: %zu", initial - tlsf_free_size());
+
+    /* Most requests fit, and once all is freed the heap is a single block
+     * again, which meets any request up to half its size.
+     */
+    if (allocs[0] < allocs[1])
+        fail("too many failed: %ld of %ld", allocs[1], allocs[0] + allocs[1]);
+    for (size = 1; size <= initial / 2; size += size / 8 + 1) {
+        b = &live[0];
+        b->p = tlsf_malloc(size);
+        if (!b->p)
+            fail("heap not merged: size %zu", size);
+        tlsf_free(b->p);
+    }
+    if (tlsf_free_size() != initial)
+        fail("free bytes lost: %zu", initial - tlsf_free_size());
+}
+
+/* Request sizes and choices drawn once, so the runs time only the heap. */
+#define REQUESTS 1000
+
+static size_t req_size[REQUESTS];
+static int req_choice[REQUESTS];
+
+/* mmtest's loop: allocate until a request fails, then free the oldest
+ * blocks until a coin toss says stop.  Counts the requests that failed and
+ * the bytes that were free when they did.
+ */
+struct run_t {
+    const struct heap_t * heap;
+    long fails;
+    double free_at_fail;
+};
+
+static void run_mmtest(void * arg) {
+    struct run_t * r = arg;
+    void * ring[256];
+    unsigned head = 0, tail = 0;
+    void * p;
+    int i;
+
+    for (i = 0; i < REQUESTS; i++) {
+        p = r->heap->malloc(req_size[i] % 1792 + 256);
+        if (p && head - tail < 256) {
+            ring[head++ % 256] = p;
+            continue;
+        }
+        r->fails++;
+        r->free_at_fail += r->heap->free_size();
+        while (head != tail) {
+            r->heap->free(ring[tail++ % 256]);
+            if (req_choice[(i + tail) % REQUESTS] & 1)
+                break;
+        }
+    }
+    while (head != tail)
+        r->heap->free(ring[tail++ % 256]);
+}
+
+/* The case a first-fit heap does worst: the heap's low end cut into small
+ * blocks with every other one free, and a request only the large free
+ * block above them can meet.
+ */
+#define HOLES 150
+
+static void * holes[2 * HOLES];
+
+static void make_holes(const struct heap_t * heap) {
+    int i;
+
+    for (i = 0; i < 2 * HOLES; i++)
+        holes[i] = heap->malloc(16);
+    for (i = 0; i < 2 * HOLES; i += 2)
+        heap->free(holes[i]);
+}
+
+static void free_holes(const struct heap_t * heap) {
+    int i;
+
+    for (i = 1; i < 2 * HOLES; i += 2)
+        heap->free(holes[i]);
+}
+
+static void run_large(void * arg) {
+    const struct heap_t * heap = arg;
+
+    heap->free(heap->malloc(1024));
+}
+
+void bench() {
+    const struct heap_t * heaps[] = { &heap4, &tlsf };
+    struct run_t r;
+    double holes_ns, ns;
+    int i;
+
+    for (i = 0; i < REQUESTS; i++) {
+        req_size[i] = rand();
+        req_choice[i] = rand();
+    }
+
+    /* ns per malloc or free among the holes and per mmtest request, and how
+     * often mmtest's requests fail.
+     */
+    printf("%-10s %12s %10s %10s %14s\n", "heap", "holes ns", "mmtest ns", "failed", "free at fail");
+    for (i = 0; i < 2; i++) {
+        make_holes(heaps[i]);
+        holes_ns = bench_ns(run_large, (void *) heaps[i]);
+        free_holes(heaps[i]);
+
+        memset(&r, 0, sizeof(r));
+        r.heap = heaps[i];
+        ns = bench_ns(run_mmtest, &r);
+
+        /* The counts of a single pass. */
+        memset(&r, 0, sizeof(r));
+        r.heap = heaps[i];
+        run_mmtest(&r);
+        printf("%-10s %12.1f %10.1f %9.1f%% %14.0f\n", heaps[i]->name, holes_ns / 2,
+               ns / REQUESTS, r.fails * 100.0 / REQUESTS, r.free_at_fail / r.fails);
+    }
+}
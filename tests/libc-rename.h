@@ -0,0 +1,33 @@
+/* Forced ahead of the firmware's libc sources when they are built for
+ * the host, so that their libc routines get names of their own and can be
+ * checked against the host's.
+ */
+#define strcat su_strcat
+#define strchr su_strchr
+#define strcmp su_strcmp
+#define strcpy su_strcpy
+#define strlen su_strlen
+#define strncmp su_strncmp
+#define strncpy su_strncpy
+#define printf su_printf
+#define dprintf su_dprintf
+#define sprintf su_sprintf
+#define snprintf su_snprintf
+#define vsnprintf su_vsnprintf
+#define puts su_puts
+#define fmt_printf su_fmt_printf
+#define __errno su_errno
+#define malloc su_malloc
+#define free su_free
+#define memchr su_memchr
+#define memcpy su_memcpy
+#define memmove su_memmove
+#define memset su_memset
+#define rand su_rand
+#define srand su_srand
+#define rand_r su_rand_r
+#define rand_fill su_rand_fill
+#define rand_fill_r su_rand_fill_r
+#define rand_stir su_rand_stir
+#define rand_entropy su_rand_entropy
+#define srand_entropy su_srand_entropy
@@ -0,0 +1,96 @@
+#define _DEFAULT_SOURCE
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include "libc-test.h"
+
+/* What string-util.c and memory-util.c need from the rest of the firmware.
+ * A test with a fio layer of its own overrides fio_write().
+ */
+
+__attribute__((weak)) int fio_write(int fd, const void * buf, size_t count) {
+    return write(fd, buf, count);
+}
+
+void * pvPortMalloc(size_t size) {
+    return malloc(size);
+}
+
+void vPortFree(void * p) {
+    free(p);
+}
+
+void * guarded_alloc(size_t size) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t span = (size + page - 1) / page * page;
+    uint8_t * base = mmap(NULL, span + page, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (base == MAP_FAILED)
+        abort();
+    mprotect(base + span, page, PROT_NONE);
+    return base + span - size;
+}
+
+void guarded_free(void * p, size_t size) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t span = (size + page - 1) / page * page;
+
+    munmap((uint8_t *) p + size - span, span + page);
+}
+
+static double now_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+double bench_ns(void (*fn)(void * arg), void * arg) {
+    long calls = 1000;
+    double start, t;
+    long i;
+
+    for (;;) {
+        start = now_ns();
+        for (i = 0; i < calls; i++)
+            fn(arg);
+        t = now_ns() - start;
+        if (t > 2e7)
+            return t / calls;
+        calls *= 4;
+    }
+}
+
+static int failures = 0;
+
+void fail(const char * fmt, ...) {
+    va_list ap;
+
+    if (failures++ >= 20)
+        return;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+}
+
+int main(int argc, char ** argv) {
+    const char * name = strrchr(argv[0], '/');
+
+    srand(1);
+
+    if (argc > 1 && !strcmp(argv[1], "-b")) {
+        bench();
+        return 0;
+    }
+
+    check();
+    printf("%s: %d failures\n", name ? name + 1 : argv[0], failures);
+    return failures != 0;
+}
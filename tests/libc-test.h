@@ -0,0 +1,47 @@
+#ifndef __LIBC_TEST_H__
+#define __LIBC_TEST_H__
+
+#include <stdarg.h>
+#include <stddef.h>
+
+/* The firmware's libc routines under their host names (libc-rename.h). */
+char *su_strcat(char *dst, const char *src);
+char *su_strchr(const char *s, int c);
+int su_strcmp(const char *a, const char *b);
+char *su_strcpy(char *dest, const char *src);
+size_t su_strlen(const char *s);
+int su_strncmp(const char *a, const char *b, size_t n);
+char *su_strncpy(char *dest, const char *src, size_t n);
+int su_sprintf(char *dst, const char *fmt, ...);
+int su_snprintf(char *dst, size_t size, const char *fmt, ...);
+int su_vsnprintf(char *dst, size_t size, const char *fmt, va_list arg_list);
+void *su_memchr(const void *src, int c, size_t n);
+void *su_memcpy(void *dest, const void *src, size_t n);
+void *su_memmove(void *dest, const void *src, size_t n);
+void *su_memset(void *dest, int c, size_t n);
+int su_rand(void);
+void su_srand(unsigned int seed);
+int su_rand_r(unsigned int *seed);
+void su_rand_fill(void *buf, size_t len);
+void su_rand_fill_r(unsigned int *seed, void *buf, size_t len);
+
+/* Buffer of size bytes whose last byte is followed by an inaccessible
+ * page, so that reading past the end faults.
+ */
+void *guarded_alloc(size_t size);
+void guarded_free(void *p, size_t size);
+
+/* Nanoseconds per call of fn(arg), timed over enough calls to matter. */
+double bench_ns(void (*fn)(void *arg), void *arg);
+
+/* Count a failed check, and describe the first few on stderr. */
+void fail(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/* Each test defines these.  main() in libc-stubs.c seeds rand() with 1 and
+ * runs bench() for "-b", or else check(), exiting with status 1 if any
+ * check failed.
+ */
+void check(void);
+void bench(void);
+
+#endif
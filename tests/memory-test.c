@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libc-test.h"
+
+/* Differential test of memcpy, memmove and memset against the host's C
+ * library, and a benchmark of the three.
+ *   memory-test        check, exit status 1 on any mismatch
+ *   memory-test -b     benchmark
+ */
+
+#define MAX_LEN 600
+#define PAD 64
+
+static void randomise(unsigned char * p, int n) {
+    int i;
+
+    for (i = 0; i < n; i++)
+        p[i] = rand();
+}
+
+static void check_copy(int len, int dalign, int salign) {
+    unsigned char src[MAX_LEN + PAD];
+    unsigned char ours[MAX_LEN + 2 * PAD];
+    unsigned char theirs[MAX_LEN + 2 * PAD];
+
+    randomise(src, sizeof(src));
+    randomise(ours, sizeof(ours));
+    memcpy(theirs, ours, sizeof(ours));
+
+    if (su_memcpy(ours + PAD + dalign, src + salign, len) != ours + PAD + dalign)
+        fail("memcpy return: len %d dest +%d src +%d", len, dalign, salign);
+    memcpy(theirs + PAD + dalign, src + salign, len);
+    if (memcmp(ours, theirs, sizeof(ours)))
+        fail("memcpy: len %d dest +%d src +%d", len, dalign, salign);
+
+    if (su_memset(ours + PAD + dalign, src[0], len) != ours + PAD + dalign)
+        fail("memset return: len %d dest +%d src +%d", len, dalign, salign);
+    memset(theirs + PAD + dalign, src[0], len);
+    if (memcmp(ours, theirs, sizeof(ours)))
+        fail("memset: len %d dest +%d src +%d", len, dalign, salign);
+}
+
+/* Move within one buffer, dest and src shift apart, either way round. */
+static void check_move(int len, int shift) {
+    unsigned char ours[MAX_LEN + 2 * PAD];
+    unsigned char theirs[MAX_LEN + 2 * PAD];
+    int from = PAD + (shift < 0 ? -shift : 0);
+
+    randomise(ours, sizeof(ours));
+    memcpy(theirs, ours, sizeof(ours));
+
+    if (su_memmove(ours + from + shift, ours + from, len) != ours + from + shift)
+        fail("memmove return: len %d shift %d", len, shift);
+    memmove(theirs + from + shift, theirs + from, len);
+    if (memcmp(ours, theirs, sizeof(ours)))
+        fail("memmove: len %d shift %d", len, shift);
+}
+
+void check() {
+    int len, dalign, salign, shift;
+
+    for (len = 0; len < 80; len++)
+        for (dalign = 0; dalign < 8; dalign++)
+            for (salign = 0; salign < 8; salign++)
+                check_copy(len, dalign, salign);
+    for (len = 80; len < MAX_LEN; len += 1 + rand() % 13)
+        check_copy(len, rand() % 8, rand() % 8);
+
+    for (len = 0; len < MAX_LEN; len += 1 + (len > 80 ? rand() % 13 : 0))
+        for (shift = -PAD + 1; shift < PAD; shift++)
+            check_move(len, shift);
+}
+
+/* Benchmark. */
+
+struct bench_arg_t {
+    unsigned char * dst;
+    unsigned char * src;
+    size_t len;
+};
+
+typedef void * (*copy_t)(void *, const void *, size_t);
+typedef void * (*set_t)(void *, int, size_t);
+
+static volatile copy_t fn_copy;
+static volatile set_t fn_set;
+
+static void run_copy(void * p) {
+    struct bench_arg_t * a = p;
+
+    fn_copy(a->dst, a->src, a->len);
+}
+
+static void run_set(void * p) {
+    struct bench_arg_t * a = p;
+
+    fn_set(a->dst, 0x5A, a->len);
+}
+
+/* The byte loops the firmware would otherwise have, for reference. */
+static void * byte_copy(void * dest, const void * src, size_t n) {
+    unsigned char * d = dest;
+    const unsigned char * s = src;
+
+    while (n--)
+        *d++ = *s++;
+    return dest;
+}
+
+static void * byte_move(void * dest, const void * src, size_t n) {
+    unsigned char * d = dest;
+    const unsigned char * s = src;
+
+    if (d <= s)
+        return byte_copy(dest, src, n);
+    while (n--)
+        d[n] = s[n];
+    return dest;
+}
+
+static void * byte_set(void * dest, int c, size_t n) {
+    unsigned char * d = dest;
+
+    while (n--)
+        *d++ = c;
+    return dest;
+}
+
+void bench() {
+    static const size_t sizes[] = { 4, 8, 16, 64, 256, 4096 };
+    static const struct {
+        const char * name;
+        copy_t ours, bytes, theirs;
+        int overlap;
+    } copies[] = {
+        { "memcpy", su_memcpy, byte_copy, memcpy, 0 },
+        { "memmove", su_memmove, byte_move, memmove, 1 },
+    };
+    struct bench_arg_t a;
+    unsigned char * buf = malloc(3 * 8192);
+    double ours, bytes, theirs;
+    int i, j, align;
+
+    printf("%-8s %5s %5s %10s %10s %10s\n", "routine", "len", "align", "ns", "bytewise", "host");
+    for (j = 0; j < (int) (sizeof(sizes) / sizeof(sizes[0])); j++) {
+        for (align = 0; align < 2; align++) {
+            a.len = sizes[j];
+            for (i = 0; i < (int) (sizeof(copies) / sizeof(copies[0])); i++) {
+                a.src = buf + 8192 + align;
+                /* memmove is timed on the backward, overlapping case. */
+                a.dst = copies[i].overlap ? buf + 8192 + 8 : buf;
+                fn_copy = copies[i].ours;
+                ours = bench_ns(run_copy, &a);
+                fn_copy = copies[i].bytes;
+                bytes = bench_ns(run_copy, &a);
+                fn_copy = copies[i].theirs;
+                theirs = bench_ns(run_copy, &a);
+                printf("%-8s %5zu %5d %10.1f %10.1f %10.1f\n", copies[i].name, a.len, align,
+                       ours, bytes, theirs);
+            }
+
+            a.dst = buf + align;
+            fn_set = su_memset;
+            ours = bench_ns(run_set, &a);
+            fn_set = byte_set;
+            bytes = bench_ns(run_set, &a);
+            fn_set = memset;
+            theirs = bench_ns(run_set, &a);
+            printf("%-8s %5zu %5d %10.1f %10.1f %10.1f\n", "memset", a.len, align,
+                   ours, bytes, theirs);
+        }
+    }
+
+    free(buf);
+}
@@ -0,0 +1,246 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libc-test.h"
+
+/* Differential test of sprintf and snprintf against the host's C library,
+ * and a benchmark of the two.
+ *   printf-test        check, exit status 1 on any mismatch
+ *   printf-test -b     benchmark
+ *
+ * string-util.c remembers parsed formats by address, so every generated
+ * format gets an address of its own and is reused many times over.
+ */
+
+#define FORMATS 600
+#define ROUNDS 200000
+#define OUT_LEN 256
+
+/* One conversion with some literal text around it. */
+struct format_t {
+    char * fmt;
+    char conv;
+    int length;
+};
+
+static struct format_t formats[FORMATS];
+static void random_text(char * p, int len) {
+    static const char chars[] = "abc xyz:=|\n";
+    int i;
+
+    for (i = 0; i < len; i++)
+        p[i] = chars[rand() % (sizeof(chars) - 1)];
+    p[len] = '\0';
+}
+
+/* Conversions both libraries define the same way: no flags, widths or
+ * precisions the firmware leaves out, and no 'h' or 'z', which it treats
+ * as int.
+ */
+static void make_format(struct format_t * f) {
+    static const char convs[] = "diuxXcsp%";
+    char buf[64];
+    char * p = buf;
+
+    random_text(p, rand() % 6);
+    p += strlen(p);
+
+    f->conv = convs[rand() % (sizeof(convs) - 1)];
+    f->length = 0;
+    *p++ = '%';
+    if (f->conv != '%') {
+        switch (rand() % 3) {
+        case 1:
+            *p++ = '-';
+            break;
+        case 2:
+            if (!strchr("csp", f->conv))
+                *p++ = '0';
+            break;
+        }
+        if (rand() % 2)
+            p += sprintf(p, "%d", rand() % 20);
+        if (!strchr("cp", f->conv) && rand() % 3 == 0)
+            p += sprintf(p, ".%d", rand() % 12);
+        if (strchr("diuxX", f->conv)) {
+            f->length = rand() % 3;
+            memset(p, 'l', f->length);
+            p += f->length;
+        }
+    }
+    *p++ = f->conv;
+
+    random_text(p, rand() % 6);
+    f->fmt = strdup(buf);
+}
+
+static long long random_value() {
+    long long v = ((long long) rand() << 40) ^ ((long long) rand() << 20) ^ rand();
+
+    /* Small numbers, zero and negatives often enough to matter. */
+    switch (rand() % 4) {
+    case 0:
+        return rand() % 3 - 1;
+    case 1:
+        return -v;
+    default:
+        return rand() % 2 ? v : v >> (rand() % 60);
+    }
+}
+
+static void check_format(const struct format_t * f) {
+    static const char * strings[] = { "", "a", "hello", "a longer string of text" };
+    char ours[OUT_LEN];
+    char theirs[OUT_LEN];
+    long long v = random_value();
+    const char * s = strings[rand() % 4];
+    void * ptr = rand() % 8 ? (void *) (uintptr_t) (unsigned) v : NULL;
+    int size = rand() % 4 ? (int) sizeof(ours) : rand() % 12;
+    int n_ours, n_theirs;
+
+    memset(ours, 'x', sizeof(ours));
+    memset(theirs, 'x', sizeof(theirs));
+
+#define BOTH(...) do { \
+        n_ours = su_snprintf(ours, size, f->fmt, __VA_ARGS__); \
+        n_theirs = snprintf(theirs, size, f->fmt, __VA_ARGS__); \
+    } while (0)
+
+    switch (f->conv) {
+    case 'c':
+        BOTH((int) (v & 0x7F) | 1);
+        break;
+    case 's':
+        BOTH(s);
+        break;
+    case 'p':
+        BOTH(ptr);
+        break;
+    case '%':
+        BOTH(0);
+        break;
+    /* long is the size of int on the target. */
+    case 'd':
+    case 'i':
+        if (f->length >= 2)
+            BOTH(v);
+        else if (f->length)
+            BOTH((long) (int) v);
+        else
+            BOTH((int) v);
+        break;
+    default:
+        if (f->length >= 2)
+            BOTH((unsigned long long) v);
+        else if (f->length)
+            BOTH((unsigned long) (unsigned) v);
+        else
+            BOTH((unsigned) v);
+        break;
+    }
+
+#undef BOTH
+
+    if (n_ours != n_theirs || memcmp(ours, theirs, sizeof(ours))) {
+        if (size < OUT_LEN)
+            ours[size] = theirs[size] = '\0';
+        fail("\"%s\": \"%s\", host \"%s\"", f->fmt, ours, theirs);
+    }
+}
+
+/* Several conversions in one format, for the walk through the arguments. */
+static void check_fixed() {
+    char ours[OUT_LEN];
+    char theirs[OUT_LEN];
+    int a = rand() - RAND_MAX / 2;
+    unsigned b = rand();
+    long long c = random_value();
+    int n_ours, n_theirs;
+
+#define BOTH(fmt, ...) do { \
+        n_ours = su_sprintf(ours, fmt, __VA_ARGS__); \
+        n_theirs = sprintf(theirs, fmt, __VA_ARGS__); \
+        if (n_ours != n_theirs || strcmp(ours, theirs)) \
+            fail("\"%s\": \"%s\", host \"%s\"", fmt, ours, theirs); \
+    } while (0)
+
+    BOTH(" %s %u\n", "file", b);
+    BOTH("%d:%x:%X:%5d|%-5d|%05d", a, b, b, a, a, a);
+    BOTH("%lld %llu %llx %d", c, c, c, a);
+    BOTH("%.3s|%8.4d|%c|%%|%u", "abcdef", a, 'q', b);
+    BOTH("%d %d %d %d %d %d %d %d %d %d %d", 1, 2, 3, 4, 5, 6, 7, 8, 9, a, a);
+    BOTH("%s%s%s%s%s%s%s%s%s", "a", "b", "c", "d", "e", "f", "g", "h", "i");
+
+#undef BOTH
+}
+
+void check() {
+    int i;
+
+    for (i = 0; i < FORMATS; i++)
+        make_format(&formats[i]);
+    for (i = 0; i < ROUNDS; i++) {
+        check_format(&formats[rand() % FORMATS]);
+        if (i % 16 == 0)
+            check_fixed();
+    }
+    for (i = 0; i < FORMATS; i++)
+        free(formats[i].fmt);
+}
+
+/* Benchmark: typical shell and debug formats, ours then the host's. */
+
+typedef int (*sprintf_t)(char *, const char *, ...);
+
+static volatile sprintf_t fn_sprintf;
+static char bench_out[OUT_LEN];
+
+static void run_int(void * p) {
+    fn_sprintf(bench_out, "%d", -123456789);
+}
+
+static void run_ls(void * p) {
+    fn_sprintf(bench_out, " %s %u\n", "README", 4096u);
+}
+
+static void run_hex(void * p) {
+    fn_sprintf(bench_out, "%08x", 0xbeefu);
+}
+
+static void run_long(void * p) {
+    fn_sprintf(bench_out, "%lld", 1234567890123456789LL);
+}
+
+static void run_iostat(void * p) {
+    fn_sprintf(bench_out, "%-8s %7u %7u %7u %9u %9u %7u\n",
+               "ttyS1", 12u, 3456u, 7u, 890123u, 45678u, 9u);
+}
+
+void bench() {
+    static const struct {
+        const char * name;
+        void (*run)(void *);
+    } tests[] = {
+        { "%d", run_int },
+        { " %s %u", run_ls },
+        { "%08x", run_hex },
+        { "%lld", run_long },
+        { "iostat", run_iostat },
+    };
+    double ours, theirs;
+    int i, len;
+
+    printf("%-8s %5s %10s %10s %10s %10s\n", "format", "len", "ns", "MB/s", "host ns", "host MB/s");
+    for (i = 0; i < (int) (sizeof(tests) / sizeof(tests[0])); i++) {
+        fn_sprintf = su_sprintf;
+        ours = bench_ns(tests[i].run, NULL);
+        len = strlen(bench_out);
+
+        fn_sprintf = sprintf;
+        theirs = bench_ns(tests[i].run, NULL);
+
+        printf("%-8s %5d %10.1f %10.1f %10.1f %10.1f\n", tests[i].name, len,
+               ours, len * 1e3 / ours, theirs, len * 1e3 / theirs);
+    }
+}
@@ -0,0 +1,230 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libc-test.h"
+
+/* Test of rand, rand_r and rand_fill, which no host library shares,
+ * against a model of the generator, and a benchmark next to the host's
+ * rand and rand_r.
+ *   random-test        check, exit status 1 on any mismatch
+ *   random-test -b     benchmark
+ */
+
+#define MAX_FILL 67
+#define THREADS 4
+#define THREAD_CALLS 200000
+#define STAT_BYTES (1 << 20)
+
+/* xorshift32 with shifts 13, 17, 5, a zero state taken as 0xACE1, and the
+ * output multiplied by 0x9E3779BB.
+ */
+static uint32_t model(unsigned * state) {
+    uint32_t x = *state ? *state : 0xACE1;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x * 0x9E3779BBu;
+}
+
+static void check_sequence(unsigned seed, int steps) {
+    unsigned state = seed;
+    unsigned r = seed;
+    int i, v;
+
+    su_srand(seed);
+    for (i = 0; i < steps; i++) {
+        v = su_rand();
+        if (v < 0 || v > RAND_MAX)
+            fail("rand range: seed 0x%08x step %d", seed, i);
+        if ((unsigned) v != model(&state) >> 1) {
+            fail("rand sequence: seed 0x%08x step %d", seed, i);
+            return;
+        }
+        if (su_rand_r(&r) != v || r != state) {
+            fail("rand_r sequence: seed 0x%08x step %d", seed, i);
+            return;
+        }
+    }
+}
+
+/* The bytes are the model's words least significant byte first, whatever
+ * the alignment, and nothing around them is touched.
+ */
+static void check_fill(unsigned seed, int len, int align) {
+    unsigned char buf[MAX_FILL + 16];
+    unsigned char expect[MAX_FILL + 16];
+    unsigned state = seed;
+    unsigned s = seed;
+    uint32_t w = 0;
+    int i;
+
+    memset(buf, 0x55, sizeof(buf));
+    memcpy(expect, buf, sizeof(buf));
+    for (i = 0; i < len; i++) {
+        if (i % 4 == 0)
+            w = model(&state);
+        expect[4 + align + i] = w >> (8 * (i % 4));
+    }
+
+    su_rand_fill_r(&s, buf + 4 + align, len);
+    if (memcmp(buf, expect, sizeof(buf)))
+        fail("rand_fill_r bytes: seed 0x%08x len %d align %d", seed, len, align);
+    if (s != state)
+        fail("rand_fill_r state: seed 0x%08x len %d align %d", seed, len, align);
+
+    /* Whole words at a time continue one another. */
+    s = seed;
+    for (i = 0; i < len; i += 8)
+        su_rand_fill_r(&s, buf + 4 + align + i, len - i < 8 ? len - i : 8);
+    if (memcmp(buf, expect, sizeof(buf)) || s != state)
+        fail("rand_fill_r in pieces: seed 0x%08x len %d align %d", seed, len, align);
+}
+
+/* Byte counts of rand_fill output against a chi-squared bound for 255
+ * degrees of freedom far out in the tail, and each bit of rand about as
+ * often set as clear.
+ */
+static void check_stats() {
+    unsigned char * buf = malloc(STAT_BYTES);
+    long counts[256] = { 0 };
+    long bits[31] = { 0 };
+    double expect = STAT_BYTES / 256.0;
+    double chi = 0;
+    int i, j, v;
+
+    su_srand(1);
+    su_rand_fill(buf, STAT_BYTES);
+    for (i = 0; i < STAT_BYTES; i++)
+        counts[buf[i]]++;
+    for (i = 0; i < 256; i++)
+        chi += (counts[i] - expect) * (counts[i] - expect) / expect;
+    if (chi > 350)
+        fail("rand_fill distribution: chi-square %.0f", chi);
+
+    for (i = 0; i < STAT_BYTES / 4; i++) {
+        v = su_rand();
+        for (j = 0; j < 31; j++)
+            bits[j] += (v >> j) & 1;
+    }
+    for (j = 0; j < 31; j++)
+        if (bits[j] < STAT_BYTES / 8 * 0.99 || bits[j] > STAT_BYTES / 8 * 1.01)
+            fail("rand bit balance: bit %d", j);
+
+    free(buf);
+}
+
+/* Threads sharing rand: between them they must take each step of the
+ * sequence exactly once.
+ */
+static int thread_out[THREADS][THREAD_CALLS];
+
+static void * rand_thread(void * arg) {
+    int * out = arg;
+    int i;
+
+    for (i = 0; i < THREAD_CALLS; i++)
+        out[i] = su_rand();
+    return NULL;
+}
+
+static int cmp_int(const void * a, const void * b) {
+    int x = *(const int *) a;
+    int y = *(const int *) b;
+
+    return (x > y) - (x < y);
+}
+
+static void check_threads() {
+    static int expect[THREADS * THREAD_CALLS];
+    pthread_t threads[THREADS];
+    unsigned state = 12345;
+    int i;
+
+    su_srand(12345);
+    for (i = 0; i < THREADS; i++)
+        pthread_create(&threads[i], NULL, rand_thread, thread_out[i]);
+    for (i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    for (i = 0; i < THREADS * THREAD_CALLS; i++)
+        expect[i] = model(&state) >> 1;
+    qsort(thread_out, THREADS * THREAD_CALLS, sizeof(int), cmp_int);
+    qsort(expect, THREADS * THREAD_CALLS, sizeof(int), cmp_int);
+    if (memcmp(thread_out, expect, sizeof(expect)))
+        fail("rand shared between threads");
+}
+
+void check() {
+    unsigned seed;
+    int i, len, align;
+
+    for (i = 0; i < 1000; i++)
+        check_sequence(rand(), 1000);
+    check_sequence(0, 1000);
+
+    for (i = 0; i < 200; i++) {
+        seed = rand();
+        for (len = 0; len <= MAX_FILL; len++)
+            for (align = 0; align < 4; align++)
+                check_fill(seed, len, align);
+    }
+
+    check_stats();
+    check_threads();
+}
+
+typedef int (*rand_t)(void);
+typedef int (*rand_r_t)(unsigned int *);
+
+static volatile rand_t fn_rand;
+static volatile rand_r_t fn_rand_r;
+static unsigned bench_seed = 1;
+static unsigned char bench_buf[4096];
+
+static void run_rand(void * p) {
+    fn_rand();
+}
+
+static void run_rand_r(void * p) {
+    fn_rand_r(&bench_seed);
+}
+
+static void run_fill(void * p) {
+    su_rand_fill_r(&bench_seed, bench_buf, sizeof(bench_buf));
+}
+
+static void run_fill_rand_r(void * p) {
+    int i;
+
+    for (i = 0; i < (int) sizeof(bench_buf); i++)
+        bench_buf[i] = fn_rand_r(&bench_seed);
+}
+
+void bench() {
+    double ours, theirs;
+
+    printf("%-10s %10s %10s %10s %10s\n", "routine", "ns", "M/s", "host ns", "host M/s");
+
+    fn_rand = su_rand;
+    ours = bench_ns(run_rand, NULL);
+    fn_rand = rand;
+    theirs = bench_ns(run_rand, NULL);
+    printf("%-10s %10.1f %10.1f %10.1f %10.1f\n", "rand", ours, 1e3 / ours, theirs, 1e3 / theirs);
+
+    fn_rand_r = su_rand_r;
+    ours = bench_ns(run_rand_r, NULL);
+    fn_rand_r = rand_r;
+    theirs = bench_ns(run_rand_r, NULL);
+    printf("%-10s %10.1f %10.1f %10.1f %10.1f\n", "rand_r", ours, 1e3 / ours, theirs, 1e3 / theirs);
+
+    /* Bytes: a fill against a byte per rand_r call. */
+    ours = bench_ns(run_fill, NULL);
+    fn_rand_r = rand_r;
+    theirs = bench_ns(run_fill_rand_r, NULL);
+    printf("%-10s %10.1f %10.1f %10.1f %10.1f  (4 KiB, MB/s)\n", "rand_fill", ours,
+           sizeof(bench_buf) * 1e3 / ours, theirs, sizeof(bench_buf) * 1e3 / theirs);
+}
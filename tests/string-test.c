@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libc-test.h"
+
+/* Differential test of the word-at-a-time string routines against the
+ * host's C library, and a benchmark of the two.
+ *   string-test        check, exit status 1 on any mismatch
+ *   string-test -b     benchmark
+ */
+
+#define MAX_LEN 300
+#define ROUNDS 20000
+
+static int sign(int x) {
+    return (x > 0) - (x < 0);
+}
+
+/* A string of len random non-zero bytes, small alphabet so that equal
+ * prefixes and found characters are common.
+ */
+static void fill(char * s, int len) {
+    int i;
+
+    for (i = 0; i < len; i++)
+        s[i] = 1 + rand() % 4 + (rand() % 8 == 0 ? 200 : 0);
+    s[len] = '\0';
+}
+
+static void check_at(char * a, char * b, int len, int align) {
+    char dst_su[MAX_LEN + 16];
+    char dst_libc[MAX_LEN + 16];
+    int blen = rand() % (len + 1);
+    int c = a[rand() % (len + 1)];
+    int n = rand() % (len + 8);
+    int dalign = rand() % 8;
+
+    if (su_strlen(a) != strlen(a))
+        fail("strlen: len %d align %d: length", len, align);
+
+    if (su_strchr(a, c) != strchr(a, c))
+        fail("strchr: len %d align %d: present or nul", len, align);
+    if (su_strchr(a, 0x7F) != strchr(a, 0x7F))
+        fail("strchr: len %d align %d: absent", len, align);
+    if (su_memchr(a, c, n > len ? len : n) != memchr(a, c, n > len ? len : n))
+        fail("memchr: len %d align %d: result", len, align);
+
+    /* b shares a random prefix with a. */
+    memcpy(b, a, blen);
+    if (sign(su_strcmp(a, b)) != sign(strcmp(a, b)))
+        fail("strcmp: len %d align %d: sign", len, align);
+    if (sign(su_strcmp(b, a)) != sign(strcmp(b, a)))
+        fail("strcmp: len %d align %d: sign reversed", len, align);
+    if (sign(su_strncmp(a, b, n)) != sign(strncmp(a, b, n)))
+        fail("strncmp: len %d align %d: sign", len, align);
+
+    memset(dst_su, 'x', sizeof(dst_su));
+    memset(dst_libc, 'x', sizeof(dst_libc));
+    if (su_strcpy(dst_su + dalign, a) != dst_su + dalign)
+        fail("strcpy: len %d align %d: return value", len, align);
+    strcpy(dst_libc + dalign, a);
+    if (memcmp(dst_su, dst_libc, sizeof(dst_su)))
+        fail("strcpy: len %d align %d: contents", len, align);
+
+    dst_su[dalign + blen] = dst_libc[dalign + blen] = '\0';
+    su_strcat(dst_su + dalign, "tail");
+    strcat(dst_libc + dalign, "tail");
+    if (memcmp(dst_su, dst_libc, sizeof(dst_su)))
+        fail("strcat: len %d align %d: contents", len, align);
+}
+
+void check() {
+    char abuf[MAX_LEN + 16];
+    char bbuf[MAX_LEN + 16];
+    char * g;
+    int i, len, align;
+
+    for (i = 0; i < ROUNDS; i++) {
+        len = rand() % MAX_LEN;
+        align = rand() % 8;
+        fill(abuf + align, len);
+        fill(bbuf + rand() % 8, len);
+        check_at(abuf + align, bbuf + rand() % 8, len, align);
+    }
+
+    /* Strings ending right before an unreadable page. */
+    for (len = 0; len < 64; len++) {
+        g = guarded_alloc(len + 1);
+        fill(g, len);
+        memcpy(bbuf, g, len + 1);
+        check_at(g, bbuf, len, len);
+        if (su_strcmp(g, bbuf) || su_strncmp(g, bbuf, len + 8))
+            fail("strcmp: len %d: guarded equal", len);
+        if (su_memchr(g, 0, len + 1) != g + len)
+            fail("memchr: len %d: guarded", len);
+        guarded_free(g, len + 1);
+    }
+}
+
+/* Benchmark: each routine over one string, ours then the host's. */
+
+struct bench_arg_t {
+    char * s;
+    char * t;
+    char * dst;
+    int len;
+};
+
+typedef size_t (*strlen_t)(const char *);
+typedef int (*strcmp_t)(const char *, const char *);
+typedef int (*strncmp_t)(const char *, const char *, size_t);
+typedef char * (*strcpy_t)(char *, const char *);
+typedef char * (*strchr_t)(const char *, int);
+typedef void * (*memchr_t)(const void *, int, size_t);
+
+/* The byte-at-a-time versions the firmware had before, for reference. */
+static size_t byte_strlen(const char * s) {
+    const char * p = s;
+
+    while (*p)
+        p++;
+    return p - s;
+}
+
+static int byte_strcmp(const char * a, const char * b) {
+    for (; *a && *a == *b; a++, b++);
+    return *(unsigned char *) a - *(unsigned char *) b;
+}
+
+static int byte_strncmp(const char * a, const char * b, size_t n) {
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        if (a[i] != b[i])
+            return a[i] - b[i];
+    return 0;
+}
+
+static char * byte_strcpy(char * dest, const char * src) {
+    char * d = dest;
+
+    while ((*d++ = *src++));
+    return dest;
+}
+
+static char * byte_strchr(const char * s, int c) {
+    for (; *s && *s != c; s++);
+    return (*s == c) ? (char *) s : NULL;
+}
+
+static void * byte_memchr(const void * src, int c, size_t n) {
+    const unsigned char * s = src;
+
+    for (; n && *s != (unsigned char) c; s++, n--);
+    return n ? (void *) s : NULL;
+}
+
+/* Called through volatile pointers so the compiler cannot substitute
+ * builtins or hoist the calls.
+ */
+static volatile strlen_t fn_strlen;
+static volatile strcmp_t fn_strcmp;
+static volatile strncmp_t fn_strncmp;
+static volatile strcpy_t fn_strcpy;
+static volatile strchr_t fn_strchr;
+static volatile memchr_t fn_memchr;
+
+static void run_strlen(void * p) {
+    struct bench_arg_t * a = p;
+
+    fn_strlen(a->s);
+}
+
+static void run_strcmp(void * p) {
+    struct bench_arg_t * a = p;
+
+    fn_strcmp(a->s, a->t);
+}
+
+static void run_strncmp(void * p) {
+    struct bench_arg_t * a = p;
+
+    fn_strncmp(a->s, a->t, a->len + 1);
+}
+
+static void run_strcpy(void * p) {
+    struct bench_arg_t * a = p;
+
+    fn_strcpy(a->dst, a->s);
+}
+
+static void run_strchr(void * p) {
+    struct bench_arg_t * a = p;
+
+    fn_strchr(a->s, 'z');
+}
+
+static void run_memchr(void * p) {
+    struct bench_arg_t * a = p;
+
+    fn_memchr(a->s, 'z', a->len);
+}
+
+void bench() {
+    static const int sizes[] = { 7, 64, 1024 };
+    static const struct {
+        const char * name;
+        void (*run)(void *);
+    } tests[] = {
+        { "strlen", run_strlen },
+        { "strcmp", run_strcmp },
+        { "strncmp", run_strncmp },
+        { "strcpy", run_strcpy },
+        { "strchr", run_strchr },
+        { "memchr", run_memchr },
+    };
+    struct bench_arg_t a;
+    char * s = malloc(2048);
+    char * t = malloc(2048);
+    char * dst = malloc(2048);
+    double ours, bytes, theirs;
+    int i, j, align;
+
+    printf("%-8s %5s %5s %10s %10s %10s\n", "routine", "len", "align", "ns", "bytewise", "host");
+    for (i = 0; i < (int) (sizeof(tests) / sizeof(tests[0])); i++) {
+        for (j = 0; j < (int) (sizeof(sizes) / sizeof(sizes[0])); j++) {
+            for (align = 0; align < 2; align++) {
+                a.s = s + align;
+                a.t = t + align;
+                a.dst = dst;
+                a.len = sizes[j];
+                memset(a.s, 'a', a.len);
+                a.s[a.len] = '\0';
+                strcpy(a.t, a.s);
+
+                fn_strlen = su_strlen;
+                fn_strcmp = su_strcmp;
+                fn_strncmp = su_strncmp;
+                fn_strcpy = su_strcpy;
+                fn_strchr = su_strchr;
+                fn_memchr = su_memchr;
+                ours = bench_ns(tests[i].run, &a);
+
+                fn_strlen = byte_strlen;
+                fn_strcmp = byte_strcmp;
+                fn_strncmp = byte_strncmp;
+                fn_strcpy = byte_strcpy;
+                fn_strchr = byte_strchr;
+                fn_memchr = byte_memchr;
+                bytes = bench_ns(tests[i].run, &a);
+
+                fn_strlen = strlen;
+                fn_strcmp = strcmp;
+                fn_strncmp = strncmp;
+                fn_strcpy = strcpy;
+                fn_strchr = strchr;
+                fn_memchr = memchr;
+                theirs = bench_ns(tests[i].run, &a);
+
+                printf("%-8s %5d %5d %10.1f %10.1f %10.1f\n", tests[i].name, a.len, align,
+                       ours, bytes, theirs);
+            }
+        }
+    }
+
+    free(s);
+    free(t);
+    free(dst);
+}
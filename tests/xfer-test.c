@@ -0,0 +1,277 @@
+#define _DEFAULT_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include "fio.h"
+#include "filesystem.h"
+#include "frame-host.h"
+#include "xfer.h"
+#include "libc-test.h"
+
+/* Test of the transfer service (xfer.c) against xferctl over a pty pair.
+ * xfer_task runs in a thread of its own on the master side, over the stub
+ * fio layer below, which keeps files in memory and drops every seventh
+ * frame each way.  xferctl is linked in as xferctl_main() on the slave
+ * side; it exits with status 1 if a transfer fails.  On a clean link, a
+ * PUT must go through without the host resending any chunk, whatever its
+ * window.
+ *   xfer-test        check, exit status 1 on any mismatch
+ *   xfer-test -b     frames each way for a PUT on a clean link
+ *
+ * Time runs ten times faster for the target than its ticks say, so that
+ * the timeouts of lost frames do not make the run slow.
+ */
+
+#define LINK_FD 100
+#define FILE_FD 10
+#define FILES 8
+#define DROP_EVERY 7
+
+int xferctl_main(int argc, char ** argv);
+
+struct mem_file_t {
+    char name[64];
+    uint8_t * data;
+    size_t size;
+    size_t cursor;
+};
+
+static struct frame_host_t target;
+static struct mem_file_t files[FILES];
+static int link_timeout_ms = -1;
+static int drop_every = DROP_EVERY;
+static unsigned link_sent, link_received;
+static unsigned data_received;
+/* The parts of fio and filesystem that xfer.c uses. */
+
+int fs_open(const char * path, int flags, int mode) {
+    struct mem_file_t * f = NULL;
+    int i;
+
+    if (!strcmp(path, "/dev/frame0"))
+        return LINK_FD;
+
+    for (i = 0; i < FILES; i++)
+        if (!strcmp(files[i].name, path))
+            f = &files[i];
+    if (!f && (flags & O_CREAT)) {
+        for (i = 0; i < FILES && files[i].name[0]; i++)
+            ;
+        if (i == FILES)
+            return -1;
+        f = &files[i];
+        snprintf(f->name, sizeof(f->name), "%s", path);
+    }
+    if (!f)
+        return -1;
+
+    if (flags & O_TRUNC)
+        f->size = 0;
+    f->cursor = 0;
+    return FILE_FD + (f - files);
+}
+
+ssize_t fio_read(int fd, void * buf, size_t count) {
+    int n;
+
+    if (fd != LINK_FD)
+        return -1;
+    do {
+        n = frame_host_recv(&target, buf, count, link_timeout_ms);
+        if (n < 0) {
+            perror("target recv");
+            exit(1);
+        }
+    } while (n > 0 && drop_every && ++link_received % drop_every == 0);
+
+    if (n > 0 && (((uint8_t *) buf)[0] == XFER_DATA || ((uint8_t *) buf)[0] == XFER_END))
+        data_received++;
+    return n;
+}
+
+ssize_t fio_write(int fd, const void * buf, size_t count) {
+    struct mem_file_t * f = &files[fd - FILE_FD];
+
+    if (fd == 2)
+        return fwrite(buf, 1, count, stderr);
+    if (fd == LINK_FD) {
+        link_sent++;
+        if (drop_every && link_sent % drop_every == 0)
+            return count;
+        return frame_host_send(&target, buf, count);
+    }
+
+    f->data = realloc(f->data, f->cursor + count);
+    memcpy(f->data + f->cursor, buf, count);
+    f->cursor += count;
+    if (f->size < f->cursor)
+        f->size = f->cursor;
+    return count;
+}
+
+ssize_t fio_pread(int fd, void * buf, size_t count, off_t offset) {
+    struct mem_file_t * f = &files[fd - FILE_FD];
+
+    if (offset >= f->size)
+        return 0;
+    if (count > f->size - offset)
+        count = f->size - offset;
+    memcpy(buf, f->data + offset, count);
+    return count;
+}
+
+off_t fio_seek(int fd, off_t offset, int whence) {
+    return -1;
+}
+
+int fio_close(int fd) {
+    return 0;
+}
+
+int fio_ioctl(int fd, int request, void * arg) {
+    portTickType ticks = *(portTickType *) arg;
+
+    if (fd != LINK_FD || request != FIO_TIMEOUT)
+        return -1;
+    link_timeout_ms = ticks == portMAX_DELAY ? -1 : ticks * 100 / configTICK_RATE_HZ;
+    return 0;
+}
+
+size_t fio_list(const char * dir, file_attr_t * buf, size_t n) {
+    return 0;
+}
+
+void console_release() {
+}
+
+void vTaskDelete(xTaskHandle task) {
+    pthread_exit(NULL);
+}
+
+static void * run_target(void * arg) {
+    xfer_task(NULL);
+    return NULL;
+}
+
+static int xferctl(const char * window, const char * tty, const char * cmd, const char * a, const char * b) {
+    char * argv[] = { "xferctl", "-t", "100", "-w", (char *) window, (char *) tty,
+                      (char *) cmd, (char *) a, (char *) b, NULL };
+
+    optind = 0;
+    return xferctl_main(9, argv);
+}
+
+/* PUT a file of size bytes and GET it back, with the host's window. */
+static void check_round_trip(const char * tty, size_t size, int window) {
+    char local[64], back[64], remote[32], w[8];
+    uint8_t * data = malloc(size + 1);
+    uint8_t * got = malloc(size + 1);
+    struct mem_file_t * f;
+    FILE * fp;
+    size_t i;
+
+    snprintf(local, sizeof(local), "/tmp/xfer-test-%d.put", (int) getpid());
+    snprintf(back, sizeof(back), "/tmp/xfer-test-%d.get", (int) getpid());
+    snprintf(remote, sizeof(remote), "/up/%zu", size);
+    snprintf(w, sizeof(w), "%d", window);
+
+    for (i = 0; i < size; i++)
+        data[i] = rand();
+    fp = fopen(local, "wb");
+    fwrite(data, 1, size, fp);
+    fclose(fp);
+
+    if (xferctl(w, tty, "put", local, remote))
+        fail("put: size %zu window %d", size, window);
+    f = &files[fs_open(remote, O_RDONLY, 0) - FILE_FD];
+    if (f->size != size || memcmp(f->data, data, size))
+        fail("put contents: size %zu window %d", size, window);
+
+    if (xferctl(w, tty, "get", remote, back))
+        fail("get: size %zu window %d", size, window);
+    fp = fopen(back, "rb");
+    if (!fp || fread(got, 1, size + 1, fp) != size || memcmp(got, data, size))
+        fail("get contents: size %zu window %d", size, window);
+    if (fp)
+        fclose(fp);
+
+    unlink(local);
+    unlink(back);
+    free(data);
+    free(got);
+}
+
+/* Each chunk of a PUT sent once: acknowledgements come often enough for
+ * the host's window.
+ */
+static void check_no_resend(const char * tty, size_t size, int window) {
+    drop_every = 0;
+    data_received = 0;
+    check_round_trip(tty, size, window);
+    if (data_received != size / XFER_CHUNK + 1)
+        fail("chunks resent: size %zu window %d", size, window);
+    drop_every = DROP_EVERY;
+}
+
+/* Start xfer_task on a new pty and return the slave's path. */
+static const char * start_target() {
+    static struct frame_host_t hold;
+    static char tty[64];
+    pthread_t thread;
+
+    if (frame_host_openpty(&target, tty, sizeof(tty)) < 0 ||
+        frame_host_open(&hold, tty) < 0) {
+        perror("pty");
+        exit(1);
+    }
+    /* xferctl opens and closes the slave on each run; holding it open
+     * keeps the master from reading end of file in between.
+     */
+    pthread_create(&thread, NULL, run_target, NULL);
+    return tty;
+}
+
+void check() {
+    static const size_t sizes[] = { 0, 1, 374, 375, 20000 };
+    const char * tty = start_target();
+    int i;
+
+    for (i = 0; i < (int) (sizeof(sizes) / sizeof(sizes[0])); i++)
+        check_round_trip(tty, sizes[i], XFER_WINDOW);
+    check_round_trip(tty, 2000, 1);
+    check_round_trip(tty, 2000, 2 * XFER_WINDOW);
+    for (i = 1; i <= 2 * XFER_WINDOW; i++)
+        check_no_resend(tty, 2000, i);
+}
+
+/* Frames each way for a PUT on a clean link, by window: what the
+ * acknowledgements cost.
+ */
+void bench() {
+    const char * tty = start_target();
+    char local[64], w[8];
+    FILE * fp;
+    int window, i;
+
+    snprintf(local, sizeof(local), "/tmp/xfer-test-%d.put", (int) getpid());
+    fp = fopen(local, "wb");
+    for (i = 0; i < 20000; i++)
+        fputc(rand(), fp);
+    fclose(fp);
+
+    drop_every = 0;
+    printf("%-8s %12s %10s\n", "window", "data frames", "replies");
+    for (window = 1; window <= 2 * XFER_WINDOW; window *= 2) {
+        snprintf(w, sizeof(w), "%d", window);
+        data_received = 0;
+        link_sent = 0;
+        if (xferctl(w, tty, "put", local, "/up/bench"))
+            fail("put: window %d", window);
+        printf("%-8d %12u %10u\n", window, data_received, link_sent);
+    }
+    unlink(local);
+}
@@ -0,0 +1,26 @@
+#ifndef __WORD_UTIL_H__
+#define __WORD_UTIL_H__
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Helpers for handling memory a machine word at a time. */
+
+#define ALIGN (sizeof(size_t))
+#define SS (sizeof(size_t))
+/* 0x01 and 0x80 in every byte. */
+#define ONES ((size_t)-1/UCHAR_MAX)
+#define HIGHS (ONES * (UCHAR_MAX/2+1))
+/* Nonzero if any byte of x is zero. */
+#define HASZERO(x) (((x)-ONES) & ~(x) & HIGHS)
+
+/* A word that may alias any other type, for reading strings by words. */
+typedef size_t __attribute__((__may_alias__)) word_t;
+
+/* Word access at any address; the Cortex-M3 allows it for LDR and STR. */
+typedef uint32_t __attribute__((__aligned__(1), __may_alias__)) u32_unaligned;
+#define LOAD32(p) (*(const u32_unaligned *)(p))
+#define STORE32(p, v) (*(u32_unaligned *)(p) = (v))
+
+#endif
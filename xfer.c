@@ -0,0 +1,290 @@
+#include <stdio.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "console.h"
+#include "fio.h"
+#include "filesystem.h"
+#include "xfer.h"
+
+/* Serial port the service listens on; USART1 leaves the console alone. */
+#ifndef XFER_PORT
+#define XFER_PORT 0
+#endif
+
+/* How long a sender waits for an acknowledgement, and a receiver for the
+ * next chunk.
+ */
+#define XFER_TIMEOUT (configTICK_RATE_HZ / 2)
+
+/* Most directory entries returned by LIST. */
+#define XFER_LIST_MAX 16
+
+/* Where GET and LIST take their data from: an open file or a buffer. */
+struct xfer_src_t {
+    int fd;
+    const char * buf;
+    int size;
+};
+
+static int xfer_link = -1;
+static uint8_t xfer_pkt[FRAME_MTU];
+static uint8_t xfer_out[FRAME_MTU];
+
+static void xfer_send(int type, uint16_t seq, const void * body, int len) {
+    xfer_out[0] = type;
+    xfer_out[1] = seq & 0xFF;
+    xfer_out[2] = seq >> 8;
+    if (len)
+        memcpy(xfer_out + XFER_HDR, body, len);
+    fio_write(xfer_link, xfer_out, XFER_HDR + len);
+}
+
+static void xfer_error(const char * msg) {
+    xfer_send(XFER_ERR, 0, msg, strlen(msg));
+}
+
+/* Receive a message into xfer_pkt, waiting at most timeout ticks.  Returns
+ * its body length, or -1 if nothing valid came.
+ */
+static int xfer_recv(portTickType timeout) {
+    int n;
+
+    fio_ioctl(xfer_link, FIO_TIMEOUT, &timeout);
+    n = fio_read(xfer_link, xfer_pkt, sizeof(xfer_pkt));
+    if (n < XFER_HDR)
+        return -1;
+    return n - XFER_HDR;
+}
+
+static uint16_t xfer_seq() {
+    return xfer_pkt[1] | (xfer_pkt[2] << 8);
+}
+
+/* The request body is a path; terminate it in place. */
+static const char * xfer_path(int len) {
+    if (len >= (int) sizeof(xfer_pkt) - XFER_HDR)
+        len = sizeof(xfer_pkt) - XFER_HDR - 1;
+    xfer_pkt[XFER_HDR + len] = '\0';
+    return (const char *) xfer_pkt + XFER_HDR;
+}
+
+/* Receive a file into fd in order, acknowledging as described in xfer.h;
+ * window is the host's, from the PUT.
+ */
+static void xfer_put(int fd, int window) {
+    uint16_t expected = 0;
+    int retries = 0;
+    int ack_every;
+    int n;
+
+    if (window == 0 || window > XFER_WINDOW)
+        window = XFER_WINDOW;
+    ack_every = window / 2 ? window / 2 : 1;
+
+    xfer_send(XFER_OK, 0, NULL, 0);
+
+    while (retries < XFER_RETRIES) {
+        n = xfer_recv(XFER_TIMEOUT);
+        if (n < 0) {
+            retries++;
+            continue;
+        }
+        retries = 0;
+
+        switch (xfer_pkt[0]) {
+        case XFER_PUT:
+            /* Our OK was lost. */
+            xfer_send(XFER_OK, 0, NULL, 0);
+            break;
+        case XFER_DATA:
+        case XFER_END:
+            if (xfer_seq() != expected) {
+                xfer_send(XFER_ACK, expected, NULL, 0);
+                break;
+            }
+            if (fio_write(fd, xfer_pkt + XFER_HDR, n) != n) {
+                xfer_error("write failed");
+                return;
+            }
+            expected++;
+            if (xfer_pkt[0] == XFER_END) {
+                xfer_send(XFER_ACK, expected, NULL, 0);
+                return;
+            }
+            if (expected % ack_every == 0)
+                xfer_send(XFER_ACK, expected, NULL, 0);
+            break;
+        }
+    }
+}
+
+static int xfer_src_read(struct xfer_src_t * src, void * buf, int len, off_t offset) {
+    int n;
+
+    if (src->fd < 0) {
+        if (offset >= src->size)
+            return 0;
+        n = src->size - offset;
+        if (n > len)
+            n = len;
+        memcpy(buf, src->buf + offset, n);
+        return n;
+    }
+
+    /* Chunks are read again on retransmission, so read by offset. */
+    n = fio_pread(src->fd, buf, len, offset);
+    if (n == -3) {
+        fio_seek(src->fd, offset, SEEK_SET);
+        n = fio_read(src->fd, buf, len);
+    }
+    return n;
+}
+
+/* Stream src to the host, go-back-N. */
+static void xfer_get(struct xfer_src_t * src) {
+    uint8_t chunk[XFER_CHUNK];
+    uint16_t base = 0;
+    uint16_t next = 0;
+    int last = -1;
+    int rewound = -1;
+    int retries = 0;
+    int n;
+
+    while (retries < XFER_RETRIES) {
+        while ((uint16_t) (next - base) < XFER_WINDOW && (last < 0 || next <= last)) {
+            n = xfer_src_read(src, chunk, XFER_CHUNK, (off_t) next * XFER_CHUNK);
+            if (n < 0) {
+                xfer_error("read failed");
+                return;
+            }
+            if (n < XFER_CHUNK)
+                last = next;
+            xfer_send(next == last ? XFER_END : XFER_DATA, next, chunk, n);
+            next++;
+        }
+
+        n = xfer_recv(XFER_TIMEOUT);
+        if (n < 0) {
+            /* Go back to the oldest chunk not acknowledged. */
+            retries++;
+            next = base;
+            continue;
+        }
+        if (xfer_pkt[0] != XFER_ACK)
+            continue;
+        retries = 0;
+        if (xfer_seq() == base) {
+            /* A repeated ACK means a chunk went missing; resend from
+             * there once instead of waiting for the timeout.
+             */
+            if (base != next && rewound != base) {
+                rewound = base;
+                next = base;
+            }
+        } else if ((uint16_t) (xfer_seq() - base) <= (uint16_t) (next - base)) {
+            base = xfer_seq();
+            if (last >= 0 && base > last)
+                return;
+        }
+    }
+}
+
+/* Format "d|- size name" lines for dir into a buffer from the heap.  On
+ * failure *size is -1 if dir cannot be listed, 0 if memory is short.
+ */
+static char * xfer_list(const char * dir, int * size) {
+    file_attr_t * entry = pvPortMalloc(sizeof(file_attr_t) * XFER_LIST_MAX);
+    char * buf = NULL;
+    char * p;
+    int len = 0;
+    int n, i;
+
+    *size = 0;
+    if (!entry)
+        return NULL;
+
+    n = fio_list(dir, entry, XFER_LIST_MAX);
+    if (!n) {
+        vPortFree(entry);
+        *size = -1;
+        return NULL;
+    }
+    for (i = 0; i < n; i++)
+        len += strlen(entry[i].name) + 14;
+
+    buf = pvPortMalloc(len + 1);
+    if (buf) {
+        p = buf;
+        for (i = 0; i < n; i++) {
+            sprintf(p, "%c %u %s\n", S_ISDIR(entry[i].mode) ? 'd' : '-',
+                    (unsigned) entry[i].size, entry[i].name);
+            p += strlen(p);
+        }
+        *size = p - buf;
+    }
+
+    vPortFree(entry);
+    return buf;
+}
+
+void xfer_task(void * pvParameters) {
+    struct xfer_src_t src;
+    char dev[12];
+    const char * path;
+    int n;
+
+    snprintf(dev, sizeof(dev), "/dev/frame%d", XFER_PORT);
+    xfer_link = fs_open(dev, O_RDWR, 0);
+    if (xfer_link < 0) {
+        fio_write(2, "xfer: cannot open link\n", 23);
+        console_release();
+        vTaskDelete(NULL);
+    }
+
+    for (;;) {
+        n = xfer_recv(portMAX_DELAY);
+        if (n < 0)
+            continue;
+
+        switch (xfer_pkt[0]) {
+        case XFER_PUT:
+            path = xfer_path(n);
+            src.fd = fs_open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (src.fd < 0) {
+                xfer_error("cannot create");
+                break;
+            }
+            xfer_put(src.fd, xfer_seq());
+            fio_close(src.fd);
+            break;
+        case XFER_GET:
+            path = xfer_path(n);
+            src.fd = fs_open(path, O_RDONLY, 0);
+            if (src.fd < 0) {
+                xfer_error("cannot open");
+                break;
+            }
+            xfer_get(&src);
+            fio_close(src.fd);
+            break;
+        case XFER_LIST:
+            path = xfer_path(n);
+            src.fd = -1;
+            src.buf = xfer_list(path, &src.size);
+            if (!src.buf) {
+                xfer_error(src.size < 0 ? "cannot list" : "out of memory");
+                break;
+            }
+            xfer_get(&src);
+            vPortFree((void *) src.buf);
+            break;
+        case XFER_END:
+            /* The host missed the ACK that ended a PUT. */
+            xfer_send(XFER_ACK, xfer_seq() + 1, NULL, 0);
+            break;
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef __XFER_H__
+#define __XFER_H__
+
+#include <stdint.h>
+#include "frame.h"
+
+/* File transfer protocol over a frame link (frame.h).  Every message is
+ * one frame: a type byte, a 16-bit little-endian sequence number and a
+ * body.
+ *
+ *   host                          target
+ *   PUT path            ->
+ *                       <-        OK | ERR message
+ *   DATA 0..n-1, END n  ->        (written in order)
+ *                       <-        ACK next
+ *
+ *   GET path | LIST dir ->
+ *                       <-        DATA 0..n-1, END n | ERR message
+ *   ACK next            ->
+ *
+ * Data moves go-back-N: the sender keeps up to XFER_WINDOW chunks in
+ * flight, and the receiver accepts chunks in order only and acknowledges
+ * with the next sequence number it expects.  Acknowledgements are sent
+ * every half window, for every chunk out of order and for END.  The window
+ * is the smaller of XFER_WINDOW and the sender's own, which a PUT carries
+ * as its sequence number (0: XFER_WINDOW).
+ * A sender that hears nothing within the timeout goes back to the oldest
+ * unacknowledged chunk.  END carries the last, possibly empty, chunk.
+ */
+
+#define XFER_HDR 3
+#define XFER_CHUNK (FRAME_MTU - XFER_HDR)
+#define XFER_WINDOW 4
+/* Consecutive timeouts before a transfer is abandoned. */
+#define XFER_RETRIES 10
+
+enum xfer_type_t {
+    XFER_PUT = 'P',
+    XFER_GET = 'G',
+    XFER_LIST = 'L',
+    XFER_DATA = 'D',
+    XFER_END = 'E',
+    XFER_ACK = 'A',
+    XFER_OK = 'K',
+    XFER_ERR = 'X',
+};
+
+/* Serve transfer requests on /dev/frame<XFER_PORT>. */
+void xfer_task(void * pvParameters);
+
+#endif
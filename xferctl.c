@@ -0,0 +1,270 @@
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "frame-host.h"
+#include "xfer.h"
+
+/* Host side of the file transfer service (xfer.h), typically run against
+ * the pty QEMU prints for -serial pty.
+ */
+
+static struct frame_host_t xlink;
+static uint8_t pkt[FRAME_MTU];
+static int timeout_ms = 500;
+static int window = XFER_WINDOW;
+
+static void usage(const char * binname) {
+    fprintf(stderr,
+            "Usage: %s [-t timeout_ms] [-w window] <tty> put <local> <remote>\n"
+            "       %s [-t timeout_ms] <tty> get <remote> [local]\n"
+            "       %s [-t timeout_ms] <tty> ls <dir>\n",
+            binname, binname, binname);
+    exit(-1);
+}
+
+static double now() {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void send_msg(int type, uint16_t seq, const void * body, int len) {
+    uint8_t out[FRAME_MTU];
+
+    out[0] = type;
+    out[1] = seq & 0xFF;
+    out[2] = seq >> 8;
+    if (len)
+        memcpy(out + XFER_HDR, body, len);
+    if (frame_host_send(&xlink, out, XFER_HDR + len) < 0) {
+        perror("send");
+        exit(1);
+    }
+}
+
+/* Receive a message into pkt.  Returns its body length, -1 on timeout. */
+static int recv_msg(int ms) {
+    int n = frame_host_recv(&xlink, pkt, sizeof(pkt), ms);
+
+    if (n < 0) {
+        perror("recv");
+        exit(1);
+    }
+    if (n < XFER_HDR)
+        return -1;
+    if (pkt[0] == XFER_ERR) {
+        fprintf(stderr, "target: %.*s\n", n - XFER_HDR, (const char *) pkt + XFER_HDR);
+        exit(1);
+    }
+    return n - XFER_HDR;
+}
+
+static uint16_t msg_seq() {
+    return pkt[1] | (pkt[2] << 8);
+}
+
+static uint8_t * load(const char * path, size_t * size) {
+    FILE * f = fopen(path, "rb");
+    uint8_t * buf = NULL;
+    size_t cap = 0;
+    size_t n;
+
+    if (!f) {
+        perror(path);
+        exit(1);
+    }
+    *size = 0;
+    do {
+        if (*size == cap) {
+            cap = cap ? cap * 2 : 4096;
+            buf = realloc(buf, cap);
+        }
+        n = fread(buf + *size, 1, cap - *size, f);
+        *size += n;
+    } while (n);
+    fclose(f);
+    return buf;
+}
+
+static size_t do_put(const char * local, const char * remote) {
+    size_t size;
+    uint8_t * data = load(local, &size);
+    int last = size / XFER_CHUNK;
+    int base = 0;
+    int next = 0;
+    int rewound = -1;
+    int retries = 0;
+    int n;
+
+    /* Ask until the target is ready to receive. */
+    for (;;) {
+        send_msg(XFER_PUT, window, remote, strlen(remote));
+        if (recv_msg(timeout_ms) >= 0 && pkt[0] == XFER_OK)
+            break;
+        if (++retries == XFER_RETRIES) {
+            fprintf(stderr, "no answer from target\n");
+            exit(1);
+        }
+    }
+
+    retries = 0;
+    while (base <= last) {
+        while (next - base < window && next <= last) {
+            int off = next * XFER_CHUNK;
+            int len = size - off < XFER_CHUNK ? size - off : XFER_CHUNK;
+
+            send_msg(next == last ? XFER_END : XFER_DATA, next, data + off, len);
+            next++;
+        }
+
+        n = recv_msg(timeout_ms);
+        if (n < 0) {
+            /* Go back to the oldest chunk not acknowledged. */
+            if (++retries == XFER_RETRIES) {
+                fprintf(stderr, "transfer timed out at chunk %d\n", base);
+                exit(1);
+            }
+            next = base;
+            continue;
+        }
+        if (pkt[0] != XFER_ACK)
+            continue;
+        retries = 0;
+        if (msg_seq() == (uint16_t) base) {
+            /* A repeated ACK means a chunk went missing; resend from
+             * there once instead of waiting for the timeout.
+             */
+            if (base < next && rewound != base) {
+                rewound = base;
+                next = base;
+            }
+        } else if ((uint16_t) (msg_seq() - base) <= (uint16_t) (next - base)) {
+            base += (uint16_t) (msg_seq() - base);
+        }
+    }
+
+    free(data);
+    return size;
+}
+
+/* Receive a GET or LIST stream into out. */
+static size_t do_recv(int type, const char * arg, FILE * out) {
+    uint16_t expected = 0;
+    size_t total = 0;
+    int retries = 0;
+    /* The target never has more than XFER_WINDOW chunks in flight. */
+    int ack_every = (window < XFER_WINDOW ? window : XFER_WINDOW) / 2;
+    double linger;
+    int n;
+
+    if (ack_every == 0)
+        ack_every = 1;
+    send_msg(type, 0, arg, strlen(arg));
+
+    for (;;) {
+        n = recv_msg(timeout_ms);
+        if (n < 0) {
+            if (++retries == XFER_RETRIES) {
+                fprintf(stderr, "transfer timed out at chunk %u\n", expected);
+                exit(1);
+            }
+            /* The request itself may have been lost. */
+            if (expected == 0)
+                send_msg(type, 0, arg, strlen(arg));
+            else
+                send_msg(XFER_ACK, expected, NULL, 0);
+            continue;
+        }
+        retries = 0;
+        if (pkt[0] != XFER_DATA && pkt[0] != XFER_END)
+            continue;
+        if (msg_seq() != expected) {
+            send_msg(XFER_ACK, expected, NULL, 0);
+            continue;
+        }
+
+        fwrite(pkt + XFER_HDR, 1, n, out);
+        total += n;
+        expected++;
+        if (pkt[0] == XFER_END)
+            break;
+        if (expected % ack_every == 0)
+            send_msg(XFER_ACK, expected, NULL, 0);
+    }
+
+    /* Stay around briefly in case the final ACK is lost and END repeated. */
+    send_msg(XFER_ACK, expected, NULL, 0);
+    linger = now() + 0.3;
+    while (now() < linger) {
+        if (frame_host_recv(&xlink, pkt, sizeof(pkt), 50) > 0 && pkt[0] == XFER_END)
+            send_msg(XFER_ACK, expected, NULL, 0);
+    }
+
+    return total;
+}
+
+int main(int argc, char ** argv) {
+    const char * binname = argv[0];
+    const char * tty;
+    const char * cmd;
+    FILE * out = stdout;
+    size_t bytes;
+    double start;
+    int c;
+
+    while ((c = getopt(argc, argv, "t:w:")) != -1) {
+        switch (c) {
+        case 't':
+            timeout_ms = atoi(optarg);
+            break;
+        case 'w':
+            window = atoi(optarg);
+            if (window < 1)
+                usage(binname);
+            break;
+        default:
+            usage(binname);
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    if (argc < 3)
+        usage(binname);
+
+    tty = argv[0];
+    cmd = argv[1];
+    if (frame_host_open(&xlink, tty) < 0) {
+        perror(tty);
+        return 1;
+    }
+
+    start = now();
+    if (!strcmp(cmd, "put") && argc == 4) {
+        bytes = do_put(argv[2], argv[3]);
+    } else if (!strcmp(cmd, "get") && (argc == 3 || argc == 4)) {
+        if (argc == 4 && !(out = fopen(argv[3], "wb"))) {
+            perror(argv[3]);
+            return 1;
+        }
+        bytes = do_recv(XFER_GET, argv[2], out);
+        if (out != stdout)
+            fclose(out);
+    } else if (!strcmp(cmd, "ls") && argc == 3) {
+        bytes = do_recv(XFER_LIST, argv[2], stdout);
+    } else {
+        usage(binname);
+        return 1;
+    }
+
+    fprintf(stderr, "%zu bytes in %.2f s (%.0f B/s), %u frames bad, %u lost\n",
+            bytes, now() - start, bytes / (now() - start),
+            xlink.rx.errors, xlink.rx.lost);
+    frame_host_close(&xlink);
+
+    return 0;
+}